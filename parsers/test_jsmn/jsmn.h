@@ -26,6 +26,23 @@
 
 #include <stddef.h>
 
+/* JSMN_VALIDATE accepts exactly RFC 8259 JSON, so it builds on strict mode */
+#if defined(JSMN_VALIDATE) && !defined(JSMN_STRICT)
+#define JSMN_STRICT
+#endif
+
+/* Scan string bodies, primitives and whitespace 16 bytes at a time where SSE2
+ * is available; define JSMN_NO_SIMD to always use the byte loops */
+#if !defined(JSMN_HEADER) && !defined(JSMN_NO_SIMD) &&                        \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define JSMN_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,22 +74,61 @@ enum jsmnerr {
   /* Invalid character inside JSON string */
   JSMN_ERROR_INVAL = -2,
   /* The string is not a full JSON packet, more bytes expected */
-  JSMN_ERROR_PART = -3
+  JSMN_ERROR_PART = -3,
+  /* The input or a container is too large for the token fields */
+  JSMN_ERROR_LIMIT = -4
 };
 
+/**
+ * Integer types for offsets, sizes and token indices. By default they are
+ * int and unsigned int, which limits input to INT_MAX bytes; define
+ * JSMN_LARGE to use pointer-sized ones for larger documents.
+ */
+#ifdef JSMN_LARGE
+typedef ptrdiff_t jsmnint_t;
+typedef size_t jsmnuint_t;
+#else
+typedef int jsmnint_t;
+typedef unsigned int jsmnuint_t;
+#endif
+
 /**
  * JSON token description.
  * type		type (object, array, string etc.)
  * start	start position in JSON data string
  * end		end position in JSON data string
+ * size		number of children (members of an object are counted once)
+ *
+ * With JSMN_COMPACT, type and size share one 32-bit word, which makes a token
+ * 12 bytes instead of 16 and limits a container to JSMN_COMPACT_MAX_SIZE
+ * children.
+ *
+ * With JSMN_NEXT_LINKS, next is the index of the token that follows this one
+ * and everything inside it, so a whole object or array can be stepped over at
+ * once. For an object key it is the index of the value, whose own next then
+ * steps over the pair. jsmn_tape.h builds lookups on it.
  */
+#ifdef JSMN_COMPACT
+#define JSMN_COMPACT_MAX_SIZE ((1 << 27) - 1)
+#endif
+
 typedef struct jsmntok {
+#ifdef JSMN_COMPACT
+  unsigned int type : 4;
+  signed int size : 28;
+#else
   jsmntype_t type;
-  int start;
-  int end;
-  int size;
+#endif
+  jsmnint_t start;
+  jsmnint_t end;
+#ifndef JSMN_COMPACT
+  jsmnint_t size;
+#endif
 #ifdef JSMN_PARENT_LINKS
-  int parent;
+  jsmnint_t parent;
+#endif
+#ifdef JSMN_NEXT_LINKS
+  jsmnint_t next;
 #endif
 } jsmntok_t;
 
@@ -81,9 +137,21 @@ typedef struct jsmntok {
  * the string being parsed now and current position in that string.
  */
 typedef struct jsmn_parser {
-  unsigned int pos;     /* offset in the JSON string */
-  unsigned int toknext; /* next token to allocate */
-  int toksuper;         /* superior token node, e.g. parent object or array */
+  jsmnuint_t pos;       /* offset in the JSON string */
+  jsmnuint_t toknext;   /* next token to allocate */
+  jsmnint_t toksuper;   /* superior token node, e.g. parent object or array */
+  jsmnint_t *stack;     /* optional stack of open objects and arrays */
+  jsmnuint_t stack_size; /* capacity of stack */
+  jsmnuint_t depth;     /* number of open objects and arrays, if stack is set */
+#ifdef JSMN_STREAM
+  jsmnuint_t offset;    /* stream offset of the JSON string, see jsmn_shift() */
+  jsmnint_t tokstart;   /* stream offset of an unfinished string or primitive */
+  jsmntype_t toktype;   /* type of that string or primitive */
+#endif
+#ifdef JSMN_VALIDATE
+  unsigned int expect;  /* what may come next, see JSMN_VALIDATE */
+  unsigned int state;   /* where reading that string or primitive stopped */
+#endif
 } jsmn_parser;
 
 /**
@@ -91,13 +159,72 @@ typedef struct jsmn_parser {
  */
 JSMN_API void jsmn_init(jsmn_parser *parser);
 
+/**
+ * Create JSON parser that keeps the indices of open objects and arrays in
+ * stack, which holds up to size entries. Finding the enclosing container
+ * after a ',' or a closing bracket then takes constant time instead of a
+ * scan back through the tokens; containers nested deeper than size fall
+ * back to the scan.
+ */
+JSMN_API void jsmn_init_stack(jsmn_parser *parser, jsmnint_t *stack,
+                              const jsmnuint_t size);
+
 /**
  * Run JSON parser. It parses a JSON data string into and array of tokens, each
  * describing
  * a single JSON object.
  */
-JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
-                        jsmntok_t *tokens, const unsigned int num_tokens);
+JSMN_API jsmnint_t jsmn_parse(jsmn_parser *parser, const char *js,
+                              const size_t len, jsmntok_t *tokens,
+                              const jsmnuint_t num_tokens);
+
+/**
+ * Allocator used by jsmn_parse_grow(). Like realloc(), it resizes the block at
+ * ptr (NULL for a new block) to size bytes and returns it, or returns NULL and
+ * leaves the block untouched if it cannot.
+ */
+typedef void *(*jsmn_realloc_t)(void *ptr, size_t size, void *user);
+
+/**
+ * Run JSON parser like jsmn_parse(), growing the token array instead of
+ * failing with JSMN_ERROR_NOMEM. *tokens and *num_tokens describe the array
+ * (NULL and 0 to let the parser allocate it) and are updated each time it is
+ * reallocated through realloc_fn. jsmn_parse() leaves the parser at the token
+ * that did not fit, so parsing resumes there and the input is scanned once.
+ * The caller owns the array, also when an error is returned.
+ */
+JSMN_API jsmnint_t jsmn_parse_grow(jsmn_parser *parser, const char *js,
+                                   const size_t len, jsmntok_t **tokens,
+                                   jsmnuint_t *num_tokens,
+                                   jsmn_realloc_t realloc_fn, void *user);
+
+/**
+ * With JSMN_VALIDATE, jsmn_parse() accepts exactly one JSON text as RFC 8259
+ * defines it, and fails with JSMN_ERROR_INVAL on anything else: a value,
+ * comma, colon or bracket out of place, a malformed number or literal, a
+ * control character or invalid UTF-8 in a string, or a NUL byte within len.
+ * Checking the grammar needs the token array, so when counting tokens only
+ * the contents of strings and primitives are checked.
+ */
+
+/**
+ * With JSMN_STREAM, the JSON data may arrive in pieces: call jsmn_parse()
+ * again with more bytes appended whenever it returns JSMN_ERROR_PART. A
+ * string or primitive cut off at the end of the input is continued where
+ * reading stopped rather than read again from its start, and token offsets
+ * count from the start of the stream rather than of js. A NUL byte, like the
+ * end of js, marks the end of the bytes received so far. As a primitive only
+ * ends at the next delimiter, end the stream with a newline to complete a
+ * top-level one such as "42".
+ *
+ * jsmn_shift() tells the parser that the first n bytes of js, which must not
+ * exceed parser->pos, have been dropped and the rest moved to the front of
+ * the buffer. The text of a token then starts at js + token.start -
+ * parser->offset, as long as the caller has kept those bytes.
+ */
+#ifdef JSMN_STREAM
+JSMN_API void jsmn_shift(jsmn_parser *parser, const jsmnuint_t n);
+#endif
 
 #ifndef JSMN_HEADER
 /**
@@ -114,21 +241,330 @@ static jsmntok_t *jsmn_alloc_token(jsmn_parser *parser, jsmntok_t *tokens,
   tok->size = 0;
 #ifdef JSMN_PARENT_LINKS
   tok->parent = -1;
+#endif
+#ifdef JSMN_NEXT_LINKS
+  /* Objects and arrays move it past their contents when closed */
+  tok->next = (jsmnint_t)parser->toknext;
 #endif
   return tok;
 }
 
+/**
+ * Returns the index of the innermost object or array that is not closed yet,
+ * or -1 if there is none.
+ */
+static jsmnint_t jsmn_open_container(const jsmn_parser *parser,
+                                     const jsmntok_t *tokens) {
+  jsmnint_t i;
+  if (parser->stack != NULL) {
+    if (parser->depth == 0) {
+      return -1;
+    }
+    if (parser->depth <= parser->stack_size) {
+      return parser->stack[parser->depth - 1];
+    }
+  }
+  /* Strings and primitives get their end when allocated, so only objects and
+   * arrays can be open */
+  for (i = parser->toknext - 1; i >= 0; i--) {
+    if (tokens[i].end == -1 && tokens[i].start != -1) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Returns the offset of the current position, counted from the start of the
+ * stream with JSMN_STREAM.
+ */
+static jsmnint_t jsmn_offset(const jsmn_parser *parser) {
+#ifdef JSMN_STREAM
+  return (jsmnint_t)(parser->offset + parser->pos);
+#else
+  return (jsmnint_t)parser->pos;
+#endif
+}
+
+/**
+ * Goes back to the start of a string or primitive that could not be read, so
+ * that the next call reads it again. A stream parser stays where it stopped.
+ */
+static void jsmn_rewind(jsmn_parser *parser, const jsmnint_t start) {
+#ifdef JSMN_STREAM
+  (void)parser;
+  (void)start;
+#else
+  parser->pos = start;
+#ifdef JSMN_VALIDATE
+  parser->state = 0;
+#endif
+#endif
+}
+
+/**
+ * Forgets the string or primitive that has just been read.
+ */
+static void jsmn_token_done(jsmn_parser *parser) {
+#ifdef JSMN_STREAM
+  parser->tokstart = -1;
+#endif
+#ifdef JSMN_VALIDATE
+  parser->state = 0;
+#endif
+  (void)parser;
+}
+
+/**
+ * Counts one more child of a container, or the value of a key.
+ */
+static int jsmn_add_child(jsmntok_t *token) {
+#ifdef JSMN_COMPACT
+  if (token->size == JSMN_COMPACT_MAX_SIZE) {
+    return JSMN_ERROR_LIMIT;
+  }
+#endif
+  token->size++;
+  return 0;
+}
+
 /**
  * Fills token type and boundaries.
  */
 static void jsmn_fill_token(jsmntok_t *token, const jsmntype_t type,
-                            const int start, const int end) {
+                            const jsmnint_t start, const jsmnint_t end) {
   token->type = type;
   token->start = start;
   token->end = end;
   token->size = 0;
 }
 
+#ifdef JSMN_SSE2
+/**
+ * Returns the index of the lowest set bit of a non-zero mask.
+ */
+static unsigned int jsmn_first_bit(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned int)__builtin_ctz(mask);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned int)index;
+#else
+  unsigned int n = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/**
+ * Returns a mask of the bytes in js[pos..pos+15] that end a run of string
+ * body: a quote, a backslash or a NUL. When validating, control characters
+ * and non-ASCII bytes (negative as signed chars) stop it too.
+ */
+static unsigned int jsmn_string_stops(const char *js, const size_t pos) {
+  const __m128i b = _mm_loadu_si128((const __m128i *)(js + pos));
+  const __m128i stop = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\"')),
+                   _mm_cmpeq_epi8(b, _mm_set1_epi8('\\'))),
+#ifdef JSMN_VALIDATE
+      _mm_cmplt_epi8(b, _mm_set1_epi8(' ')));
+#else
+      _mm_cmpeq_epi8(b, _mm_setzero_si128()));
+#endif
+  return (unsigned int)_mm_movemask_epi8(stop);
+}
+
+/**
+ * Returns a mask of the bytes in js[pos..pos+15] that a primitive cannot
+ * simply continue with: delimiters, and control or non-ASCII bytes (negative
+ * as signed chars), which the byte loop then rejects.
+ */
+static unsigned int jsmn_primitive_stops(const char *js, const size_t pos) {
+  const __m128i b = _mm_loadu_si128((const __m128i *)(js + pos));
+  __m128i stop = _mm_or_si128(_mm_cmplt_epi8(b, _mm_set1_epi8(' ' + 1)),
+                              _mm_cmpeq_epi8(b, _mm_set1_epi8(127)));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8(',')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8(']')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8('}')));
+#ifndef JSMN_STRICT
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8(':')));
+#endif
+  return (unsigned int)_mm_movemask_epi8(stop);
+}
+
+/**
+ * Returns a mask of the bytes in js[pos..pos+15] that are not whitespace.
+ */
+static unsigned int jsmn_whitespace_stops(const char *js, const size_t pos) {
+  const __m128i b = _mm_loadu_si128((const __m128i *)(js + pos));
+  const __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(b, _mm_set1_epi8('\n'))),
+      _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\r')),
+                   _mm_cmpeq_epi8(b, _mm_set1_epi8('\t'))));
+  return (unsigned int)_mm_movemask_epi8(ws) ^ 0xFFFF;
+}
+
+/**
+ * Skips ahead from pos to the first byte flagged by stops(), or to where
+ * fewer than 16 bytes remain, whichever comes first. Once a run has proved
+ * longer than 16 bytes, it is checked 64 bytes per iteration.
+ */
+static size_t jsmn_skip(const char *js, size_t pos, const size_t len,
+                        unsigned int (*stops)(const char *, const size_t)) {
+  unsigned int mask;
+  for (;;) {
+    if (pos + 16 > len) {
+      return pos;
+    }
+    mask = stops(js, pos);
+    if (mask != 0) {
+      return pos + jsmn_first_bit(mask);
+    }
+    pos += 16;
+    while (pos + 64 <= len &&
+           (stops(js, pos) | stops(js, pos + 16) | stops(js, pos + 32) |
+            stops(js, pos + 48)) == 0) {
+      pos += 64;
+    }
+  }
+}
+#endif
+
+#ifdef JSMN_VALIDATE
+/**
+ * Bits of parser->expect: what may come next. It is 0 once the top-level
+ * value is complete.
+ */
+enum {
+  JSMN_EXPECT_VALUE = 1 << 0,
+  JSMN_EXPECT_KEY = 1 << 1,
+  JSMN_EXPECT_COLON = 1 << 2,
+  JSMN_EXPECT_COMMA = 1 << 3,
+  JSMN_EXPECT_CLOSE = 1 << 4
+};
+
+/**
+ * Returns whether c is a decimal digit.
+ */
+static int jsmn_is_digit(const char c) {
+  return (unsigned char)(c - '0') < 10;
+}
+
+/**
+ * Returns whether the text from p to end is a number or one of the literals
+ * true, false and null. The scan that found end has already rejected
+ * control characters and non-ASCII bytes.
+ */
+static int jsmn_valid_primitive(const char *p, const char *end) {
+  const char *literal;
+  switch (*p) {
+  case 't':
+    literal = "true";
+    break;
+  case 'f':
+    literal = "false";
+    break;
+  case 'n':
+    literal = "null";
+    break;
+  default:
+    /* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+    if (*p == '-') {
+      p++;
+    }
+    if (p == end || !jsmn_is_digit(*p)) {
+      return 0;
+    }
+    if (*p++ != '0') {
+      while (p != end && jsmn_is_digit(*p)) {
+        p++;
+      }
+    }
+    if (p != end && *p == '.') {
+      if (++p == end || !jsmn_is_digit(*p)) {
+        return 0;
+      }
+      while (p != end && jsmn_is_digit(*p)) {
+        p++;
+      }
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+      if (++p != end && (*p == '+' || *p == '-')) {
+        p++;
+      }
+      if (p == end || !jsmn_is_digit(*p)) {
+        return 0;
+      }
+      while (p != end && jsmn_is_digit(*p)) {
+        p++;
+      }
+    }
+    return p == end;
+  }
+  for (; *literal != '\0'; literal++, p++) {
+    if (p == end || *p != *literal) {
+      return 0;
+    }
+  }
+  return p == end;
+}
+
+/**
+ * States of the automaton that checks UTF-8 in strings: 0 between characters,
+ * 1-3 for the number of continuation bytes still due, 4-7 for the second byte
+ * after E0, ED, F0 and F4, whose range is narrower, and 8 for an error.
+ */
+#define JSMN_UTF8_ERROR 8
+
+/**
+ * Class of each byte from 128 up: 1-3 continuation bytes 80-8F, 90-9F and
+ * A0-BF, 4 leading C2-DF, 5 E0, 6 other leading E1-EF, 7 ED, 8 F0, 9 F1-F3,
+ * 10 F4, and 11 for bytes that never occur.
+ */
+static const unsigned char jsmn_utf8_class[128] = {
+   1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+   2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+   3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+   3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+  11, 11,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+   4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+   5,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  7,  6,  6,
+   8,  9,  9,  9, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11};
+
+/**
+ * Next state by current state and byte class.
+ */
+static const unsigned char jsmn_utf8_next[8][12] = {
+    {8, 8, 8, 8, 1, 4, 2, 5, 6, 3, 7, 8}, {8, 0, 0, 0, 8, 8, 8, 8, 8, 8, 8, 8},
+    {8, 1, 1, 1, 8, 8, 8, 8, 8, 8, 8, 8}, {8, 2, 2, 2, 8, 8, 8, 8, 8, 8, 8, 8},
+    {8, 8, 8, 1, 8, 8, 8, 8, 8, 8, 8, 8}, {8, 1, 1, 8, 8, 8, 8, 8, 8, 8, 8, 8},
+    {8, 8, 2, 2, 8, 8, 8, 8, 8, 8, 8, 8}, {8, 2, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}};
+
+/**
+ * Returns whether tokens are being filled and none of what may come next
+ * matches.
+ */
+static int jsmn_unexpected(const jsmn_parser *parser, const jsmntok_t *tokens,
+                           const unsigned int what) {
+  return tokens != NULL && (parser->expect & what) == 0;
+}
+
+/**
+ * Sets what may follow a complete value: a ',' or a closing bracket, or
+ * nothing at the top level.
+ */
+static void jsmn_value_done(jsmn_parser *parser) {
+  parser->expect = parser->toksuper == -1
+                       ? 0
+                       : (unsigned int)(JSMN_EXPECT_COMMA | JSMN_EXPECT_CLOSE);
+}
+#endif
+
 /**
  * Fills next available token with JSON primitive.
  */
@@ -136,11 +572,26 @@ static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
                                 const size_t len, jsmntok_t *tokens,
                                 const size_t num_tokens) {
   jsmntok_t *token;
-  int start;
+  jsmnint_t start;
 
+#ifdef JSMN_STREAM
+  /* Carry on with a primitive that the previous input ended in */
+  if (parser->tokstart == -1) {
+    parser->tokstart = jsmn_offset(parser);
+    parser->toktype = JSMN_PRIMITIVE;
+  }
+  start = parser->tokstart;
+#else
   start = parser->pos;
+#endif
 
   for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
+#ifdef JSMN_SSE2
+    parser->pos = jsmn_skip(js, parser->pos, len, jsmn_primitive_stops);
+    if (parser->pos == len || js[parser->pos] == '\0') {
+      break;
+    }
+#endif
     switch (js[parser->pos]) {
 #ifndef JSMN_STRICT
     /* In strict mode primitive must be followed by "," or "}" or "]" */
@@ -159,34 +610,83 @@ static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
       break;
     }
     if (js[parser->pos] < 32 || js[parser->pos] >= 127) {
-      parser->pos = start;
+      jsmn_rewind(parser, start);
       return JSMN_ERROR_INVAL;
     }
   }
-#ifdef JSMN_STRICT
-  /* In strict mode primitive must be followed by a comma/object/array */
-  parser->pos = start;
+#if defined(JSMN_VALIDATE) && !defined(JSMN_STREAM)
+  /* The end of the input ends a top-level primitive like a delimiter, but
+   * JSON text cannot contain a NUL byte */
+  if (parser->pos == len) {
+    goto found;
+  }
+  jsmn_rewind(parser, start);
+  return JSMN_ERROR_INVAL;
+#elif defined(JSMN_VALIDATE)
+  /* Read a cut-off primitive again whole, so that it can be checked at once */
+  parser->pos = start - parser->offset;
+  parser->tokstart = -1;
+  return JSMN_ERROR_PART;
+#elif defined(JSMN_STRICT) || defined(JSMN_STREAM)
+  /* In strict mode primitive must be followed by a comma/object/array, and
+   * in a stream the next input may continue it */
+  jsmn_rewind(parser, start);
   return JSMN_ERROR_PART;
 #endif
 
 found:
+#ifdef JSMN_VALIDATE
+  /* The primitive is the jsmn_offset(parser) - start bytes before pos */
+  if (!jsmn_valid_primitive(js + parser->pos - (jsmn_offset(parser) - start),
+                            js + parser->pos)) {
+    jsmn_rewind(parser, start);
+    return JSMN_ERROR_INVAL;
+  }
+#endif
   if (tokens == NULL) {
+    jsmn_token_done(parser);
     parser->pos--;
     return 0;
   }
   token = jsmn_alloc_token(parser, tokens, num_tokens);
   if (token == NULL) {
-    parser->pos = start;
+    jsmn_rewind(parser, start);
     return JSMN_ERROR_NOMEM;
   }
-  jsmn_fill_token(token, JSMN_PRIMITIVE, start, parser->pos);
+  jsmn_fill_token(token, JSMN_PRIMITIVE, start, jsmn_offset(parser));
 #ifdef JSMN_PARENT_LINKS
   token->parent = parser->toksuper;
 #endif
+  jsmn_token_done(parser);
   parser->pos--;
   return 0;
 }
 
+#ifdef JSMN_STREAM
+/**
+ * Returns whether the input ends within the escape sequence at js[pos], before
+ * it could turn out to be invalid.
+ */
+static int jsmn_escape_cut(const char *js, const size_t pos,
+                           const size_t len) {
+  size_t n = 2, i;
+  if (pos + 1 < len && js[pos + 1] == 'u') {
+    n = 6;
+  }
+  for (i = 1; i < n; i++) {
+    const char c = pos + i < len ? js[pos + i] : '\0';
+    if (c == '\0') {
+      return 1;
+    }
+    if (i > 1 && !((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') ||
+                   (c >= 'a' && c <= 'f'))) {
+      return 0;
+    }
+  }
+  return 0;
+}
+#endif
+
 /**
  * Fills next token with JSON string.
  */
@@ -194,32 +694,89 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
                              const size_t len, jsmntok_t *tokens,
                              const size_t num_tokens) {
   jsmntok_t *token;
+  jsmnint_t start;
+#ifdef JSMN_VALIDATE
+  unsigned int state = parser->state;
+#endif
+
+#ifdef JSMN_STREAM
+  /* Carry on with a string that the previous input ended in */
+  if (parser->tokstart == -1) {
+    parser->tokstart = jsmn_offset(parser);
+    parser->toktype = JSMN_STRING;
+    parser->pos++;
+  }
+  start = parser->tokstart;
+#else
+  start = parser->pos;
 
-  int start = parser->pos;
-  
   /* Skip starting quote */
   parser->pos++;
-  
+#endif
+
   for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
-    char c = js[parser->pos];
+    char c;
+#ifdef JSMN_SSE2
+#ifdef JSMN_VALIDATE
+    /* Skip only between UTF-8 characters */
+    if (state == 0) {
+      parser->pos = jsmn_skip(js, parser->pos, len, jsmn_string_stops);
+    }
+#else
+    parser->pos = jsmn_skip(js, parser->pos, len, jsmn_string_stops);
+#endif
+    if (parser->pos == len || js[parser->pos] == '\0') {
+      break;
+    }
+#endif
+    c = js[parser->pos];
+
+#ifdef JSMN_VALIDATE
+    /* Non-ASCII bytes must form UTF-8 characters */
+    if ((unsigned char)c >= 128) {
+      state = jsmn_utf8_next[state][jsmn_utf8_class[(unsigned char)c - 128]];
+      if (state == JSMN_UTF8_ERROR) {
+        jsmn_rewind(parser, start);
+        return JSMN_ERROR_INVAL;
+      }
+      continue;
+    }
+    /* and ASCII ones must not cut them off or be control characters */
+    if (state != 0 || (unsigned char)c < ' ') {
+      jsmn_rewind(parser, start);
+      return JSMN_ERROR_INVAL;
+    }
+#endif
 
     /* Quote: end of string */
     if (c == '\"') {
       if (tokens == NULL) {
+        jsmn_token_done(parser);
         return 0;
       }
       token = jsmn_alloc_token(parser, tokens, num_tokens);
       if (token == NULL) {
-        parser->pos = start;
+        jsmn_rewind(parser, start);
         return JSMN_ERROR_NOMEM;
       }
-      jsmn_fill_token(token, JSMN_STRING, start + 1, parser->pos);
+      jsmn_fill_token(token, JSMN_STRING, start + 1, jsmn_offset(parser));
 #ifdef JSMN_PARENT_LINKS
       token->parent = parser->toksuper;
 #endif
+      jsmn_token_done(parser);
       return 0;
     }
 
+#ifdef JSMN_STREAM
+    /* Stop at an escape that is cut off, to read it whole next time */
+    if (c == '\\' && jsmn_escape_cut(js, parser->pos, len)) {
+#ifdef JSMN_VALIDATE
+      parser->state = state;
+#endif
+      return JSMN_ERROR_PART;
+    }
+#endif
+
     /* Backslash: Quoted symbol expected */
     if (c == '\\' && parser->pos + 1 < len) {
       int i;
@@ -244,7 +801,7 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
           if (!((js[parser->pos] >= 48 && js[parser->pos] <= 57) ||   /* 0-9 */
                 (js[parser->pos] >= 65 && js[parser->pos] <= 70) ||   /* A-F */
                 (js[parser->pos] >= 97 && js[parser->pos] <= 102))) { /* a-f */
-            parser->pos = start;
+            jsmn_rewind(parser, start);
             return JSMN_ERROR_INVAL;
           }
           parser->pos++;
@@ -253,30 +810,60 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
         break;
       /* Unexpected symbol */
       default:
-        parser->pos = start;
+        jsmn_rewind(parser, start);
         return JSMN_ERROR_INVAL;
       }
     }
   }
-  parser->pos = start;
+#ifdef JSMN_VALIDATE
+#ifndef JSMN_STREAM
+  /* JSON text cannot contain a NUL byte */
+  if (parser->pos < len) {
+    jsmn_rewind(parser, start);
+    return JSMN_ERROR_INVAL;
+  }
+#endif
+  parser->state = state;
+#endif
+  jsmn_rewind(parser, start);
   return JSMN_ERROR_PART;
 }
 
 /**
  * Parse JSON string and fill tokens.
  */
-JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
-                        jsmntok_t *tokens, const unsigned int num_tokens) {
+JSMN_API jsmnint_t jsmn_parse(jsmn_parser *parser, const char *js,
+                              const size_t len, jsmntok_t *tokens,
+                              const jsmnuint_t num_tokens) {
   int r;
-  int i;
+#ifndef JSMN_PARENT_LINKS
+  jsmnint_t i;
+#endif
   jsmntok_t *token;
-  int count = parser->toknext;
+  jsmnint_t count = parser->toknext;
+#ifndef JSMN_LARGE
+  size_t max_len = (size_t)((unsigned int)-1 >> 1);
+
+  /* Offsets are ints, and in a stream they count the bytes dropped before */
+#ifdef JSMN_STREAM
+  max_len -= parser->offset;
+#endif
+  if (len > max_len) {
+    return JSMN_ERROR_LIMIT;
+  }
+#endif
 
   for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
     char c;
     jsmntype_t type;
 
     c = js[parser->pos];
+#ifdef JSMN_STREAM
+    /* Go back into the string or primitive the previous input ended in */
+    if (parser->tokstart != -1) {
+      c = parser->toktype == JSMN_STRING ? '\"' : '0';
+    }
+#endif
     switch (c) {
     case '{':
     case '[':
@@ -284,32 +871,54 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
       if (tokens == NULL) {
         break;
       }
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens, JSMN_EXPECT_VALUE)) {
+        return JSMN_ERROR_INVAL;
+      }
+#endif
       token = jsmn_alloc_token(parser, tokens, num_tokens);
       if (token == NULL) {
         return JSMN_ERROR_NOMEM;
       }
       if (parser->toksuper != -1) {
         jsmntok_t *t = &tokens[parser->toksuper];
-#ifdef JSMN_STRICT
+#if defined(JSMN_STRICT) && !defined(JSMN_VALIDATE)
         /* In strict mode an object or array can't become a key */
         if (t->type == JSMN_OBJECT) {
           return JSMN_ERROR_INVAL;
         }
 #endif
-        t->size++;
+        if (jsmn_add_child(t) < 0) {
+          return JSMN_ERROR_LIMIT;
+        }
 #ifdef JSMN_PARENT_LINKS
         token->parent = parser->toksuper;
 #endif
       }
       token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
-      token->start = parser->pos;
+      token->start = jsmn_offset(parser);
       parser->toksuper = parser->toknext - 1;
+      if (parser->stack != NULL) {
+        if (parser->depth < parser->stack_size) {
+          parser->stack[parser->depth] = parser->toksuper;
+        }
+        parser->depth++;
+      }
+#ifdef JSMN_VALIDATE
+      parser->expect = c == '{' ? JSMN_EXPECT_KEY | JSMN_EXPECT_CLOSE
+                                : JSMN_EXPECT_VALUE | JSMN_EXPECT_CLOSE;
+#endif
       break;
     case '}':
     case ']':
       if (tokens == NULL) {
         break;
       }
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens, JSMN_EXPECT_CLOSE)) {
+        return JSMN_ERROR_INVAL;
+      }
+#endif
       type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
 #ifdef JSMN_PARENT_LINKS
       if (parser->toknext < 1) {
@@ -321,8 +930,14 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
           if (token->type != type) {
             return JSMN_ERROR_INVAL;
           }
-          token->end = parser->pos + 1;
+          token->end = jsmn_offset(parser) + 1;
+#ifdef JSMN_NEXT_LINKS
+          token->next = (jsmnint_t)parser->toknext;
+#endif
           parser->toksuper = token->parent;
+          if (parser->stack != NULL) {
+            parser->depth--;
+          }
           break;
         }
         if (token->parent == -1) {
@@ -334,65 +949,96 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
         token = &tokens[token->parent];
       }
 #else
-      for (i = parser->toknext - 1; i >= 0; i--) {
-        token = &tokens[i];
-        if (token->start != -1 && token->end == -1) {
-          if (token->type != type) {
-            return JSMN_ERROR_INVAL;
-          }
-          parser->toksuper = -1;
-          token->end = parser->pos + 1;
-          break;
-        }
-      }
+      i = jsmn_open_container(parser, tokens);
       /* Error if unmatched closing bracket */
       if (i == -1) {
         return JSMN_ERROR_INVAL;
       }
-      for (; i >= 0; i--) {
-        token = &tokens[i];
-        if (token->start != -1 && token->end == -1) {
-          parser->toksuper = i;
-          break;
-        }
+      token = &tokens[i];
+      if (token->type != type) {
+        return JSMN_ERROR_INVAL;
+      }
+      token->end = jsmn_offset(parser) + 1;
+#ifdef JSMN_NEXT_LINKS
+      token->next = (jsmnint_t)parser->toknext;
+#endif
+      if (parser->stack != NULL) {
+        parser->depth--;
       }
+      parser->toksuper = jsmn_open_container(parser, tokens);
+#endif
+#ifdef JSMN_VALIDATE
+      jsmn_value_done(parser);
 #endif
       break;
     case '\"':
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens,
+                          JSMN_EXPECT_KEY | JSMN_EXPECT_VALUE)) {
+        return JSMN_ERROR_INVAL;
+      }
+#endif
       r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
       if (r < 0) {
         return r;
       }
       count++;
-      if (parser->toksuper != -1 && tokens != NULL) {
-        tokens[parser->toksuper].size++;
+      if (parser->toksuper != -1 && tokens != NULL &&
+          jsmn_add_child(&tokens[parser->toksuper]) < 0) {
+        return JSMN_ERROR_LIMIT;
       }
+#ifdef JSMN_VALIDATE
+      if (parser->expect & JSMN_EXPECT_KEY) {
+        parser->expect = JSMN_EXPECT_COLON;
+      } else {
+        jsmn_value_done(parser);
+      }
+#endif
       break;
     case '\t':
     case '\r':
     case '\n':
     case ' ':
+#ifdef JSMN_SSE2
+      /* Skip the rest of a run of indentation at once */
+      parser->pos =
+          jsmn_skip(js, parser->pos + 1, len, jsmn_whitespace_stops) - 1;
+#endif
       break;
     case ':':
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens, JSMN_EXPECT_COLON)) {
+        return JSMN_ERROR_INVAL;
+      }
+      parser->expect = JSMN_EXPECT_VALUE;
+#endif
       parser->toksuper = parser->toknext - 1;
       break;
     case ',':
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens, JSMN_EXPECT_COMMA)) {
+        return JSMN_ERROR_INVAL;
+      }
+#endif
       if (tokens != NULL && parser->toksuper != -1 &&
           tokens[parser->toksuper].type != JSMN_ARRAY &&
           tokens[parser->toksuper].type != JSMN_OBJECT) {
 #ifdef JSMN_PARENT_LINKS
         parser->toksuper = tokens[parser->toksuper].parent;
 #else
-        for (i = parser->toknext - 1; i >= 0; i--) {
-          if (tokens[i].type == JSMN_ARRAY || tokens[i].type == JSMN_OBJECT) {
-            if (tokens[i].start != -1 && tokens[i].end == -1) {
-              parser->toksuper = i;
-              break;
-            }
-          }
+        i = jsmn_open_container(parser, tokens);
+        if (i != -1) {
+          parser->toksuper = i;
         }
 #endif
       }
+#ifdef JSMN_VALIDATE
+      if (tokens != NULL) {
+        parser->expect = tokens[parser->toksuper].type == JSMN_OBJECT
+                             ? JSMN_EXPECT_KEY
+                             : JSMN_EXPECT_VALUE;
+      }
+#endif
       break;
 #ifdef JSMN_STRICT
     /* In strict mode primitives are: numbers and booleans */
@@ -410,6 +1056,11 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
     case 't':
     case 'f':
     case 'n':
+#ifdef JSMN_VALIDATE
+      if (jsmn_unexpected(parser, tokens, JSMN_EXPECT_VALUE)) {
+        return JSMN_ERROR_INVAL;
+      }
+#else
       /* And they must not be keys of the object */
       if (tokens != NULL && parser->toksuper != -1) {
         const jsmntok_t *t = &tokens[parser->toksuper];
@@ -418,6 +1069,7 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
           return JSMN_ERROR_INVAL;
         }
       }
+#endif
 #else
     /* In non-strict mode every unquoted value is a primitive */
     default:
@@ -427,9 +1079,13 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
         return r;
       }
       count++;
-      if (parser->toksuper != -1 && tokens != NULL) {
-        tokens[parser->toksuper].size++;
+      if (parser->toksuper != -1 && tokens != NULL &&
+          jsmn_add_child(&tokens[parser->toksuper]) < 0) {
+        return JSMN_ERROR_LIMIT;
       }
+#ifdef JSMN_VALIDATE
+      jsmn_value_done(parser);
+#endif
       break;
 
 #ifdef JSMN_STRICT
@@ -440,18 +1096,71 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
     }
   }
 
-  if (tokens != NULL) {
-    for (i = parser->toknext - 1; i >= 0; i--) {
-      /* Unmatched opened object or array */
-      if (tokens[i].start != -1 && tokens[i].end == -1) {
-        return JSMN_ERROR_PART;
-      }
-    }
+#if defined(JSMN_VALIDATE) && !defined(JSMN_STREAM)
+  /* JSON text cannot contain a NUL byte */
+  if (parser->pos < len) {
+    return JSMN_ERROR_INVAL;
   }
+#endif
+
+#ifdef JSMN_STREAM
+  /* Input ended in a string or primitive */
+  if (parser->tokstart != -1) {
+    return JSMN_ERROR_PART;
+  }
+#endif
+
+  /* Unmatched opened object or array */
+  if (tokens != NULL && jsmn_open_container(parser, tokens) != -1) {
+    return JSMN_ERROR_PART;
+  }
+
+#ifdef JSMN_VALIDATE
+  /* No value yet, or no value after the last key, ':' or ',' */
+  if (tokens != NULL && parser->expect != 0) {
+    return JSMN_ERROR_PART;
+  }
+#endif
 
   return count;
 }
 
+/**
+ * Parse JSON string, growing the token array as needed.
+ */
+JSMN_API jsmnint_t jsmn_parse_grow(jsmn_parser *parser, const char *js,
+                                   const size_t len, jsmntok_t **tokens,
+                                   jsmnuint_t *num_tokens,
+                                   jsmn_realloc_t realloc_fn, void *user) {
+  for (;;) {
+    jsmnint_t r;
+    jsmnuint_t size;
+    size_t bytes;
+    void *grown;
+
+    /* A NULL array would make jsmn_parse() only count tokens */
+    if (*tokens != NULL) {
+      r = jsmn_parse(parser, js, len, *tokens, *num_tokens);
+      if (r != JSMN_ERROR_NOMEM) {
+        return r;
+      }
+    }
+
+    /* Double the pool; give up if that overflows */
+    size = *num_tokens < 64 ? 64 : *num_tokens * 2;
+    bytes = (size_t)size * sizeof(jsmntok_t);
+    if (size <= *num_tokens || bytes / sizeof(jsmntok_t) != size) {
+      return JSMN_ERROR_NOMEM;
+    }
+    grown = realloc_fn(*tokens, bytes, user);
+    if (grown == NULL) {
+      return JSMN_ERROR_NOMEM;
+    }
+    *tokens = (jsmntok_t *)grown;
+    *num_tokens = size;
+  }
+}
+
 /**
  * Creates a new parser based over a given buffer with an array of tokens
  * available.
@@ -460,8 +1169,40 @@ JSMN_API void jsmn_init(jsmn_parser *parser) {
   parser->pos = 0;
   parser->toknext = 0;
   parser->toksuper = -1;
+  parser->stack = NULL;
+  parser->stack_size = 0;
+  parser->depth = 0;
+#ifdef JSMN_STREAM
+  parser->offset = 0;
+  parser->tokstart = -1;
+  parser->toktype = JSMN_UNDEFINED;
+#endif
+#ifdef JSMN_VALIDATE
+  parser->expect = JSMN_EXPECT_VALUE;
+  parser->state = 0;
+#endif
 }
 
+/**
+ * Creates a new parser that tracks open objects and arrays in stack.
+ */
+JSMN_API void jsmn_init_stack(jsmn_parser *parser, jsmnint_t *stack,
+                              const jsmnuint_t size) {
+  jsmn_init(parser);
+  parser->stack = stack;
+  parser->stack_size = size;
+}
+
+#ifdef JSMN_STREAM
+/**
+ * Moves a stream parser to the front of its input after n bytes are dropped.
+ */
+JSMN_API void jsmn_shift(jsmn_parser *parser, const jsmnuint_t n) {
+  parser->pos -= n;
+  parser->offset += n;
+}
+#endif
+
 #endif /* JSMN_HEADER */
 
 #ifdef __cplusplus
@@ -0,0 +1,142 @@
+/*
+ * A parser context to reuse across documents, such as one per thread of a
+ * server. It owns a token pool that grows through jsmn_parse_grow() as
+ * documents need and is kept between them, so a steady stream of requests
+ * parses without allocating. A single large document would otherwise pin its
+ * pool for good: every JSMN_CTX_TRIM_INTERVAL documents, a pool that has
+ * grown to over four times the most tokens any of them used is shrunk to
+ * twice that.
+ *
+ * A context is not locked, so give each thread its own. Like jsmn.h, define
+ * JSMN_HEADER in all but one file that includes it.
+ */
+#ifndef JSMN_CTX_H
+#define JSMN_CTX_H
+
+#include "jsmn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Depth of open objects and arrays tracked in a context's own stack; deeper
+ * ones fall back to the scan, see jsmn_init_stack() */
+#ifndef JSMN_CTX_STACK
+#define JSMN_CTX_STACK 64
+#endif
+
+/* Documents between checks whether the pool has outgrown them */
+#ifndef JSMN_CTX_TRIM_INTERVAL
+#define JSMN_CTX_TRIM_INTERVAL 256
+#endif
+
+/**
+ * Parser context. tokens holds the tokens of the current document, and
+ * num_tokens is the size of the pool, not the number of tokens parsed.
+ */
+typedef struct jsmn_ctx {
+  jsmn_parser parser;
+  jsmntok_t *tokens;         /* token pool */
+  jsmnuint_t num_tokens;     /* capacity of tokens */
+  jsmnuint_t high_water;     /* most tokens used since the last trim check */
+  unsigned int documents;    /* documents since the last trim check */
+  jsmn_realloc_t realloc_fn; /* allocator of the pool */
+  void *user;                /* argument for realloc_fn */
+  jsmnint_t stack[JSMN_CTX_STACK];
+} jsmn_ctx;
+
+/**
+ * Sets up a context with an empty pool, ready for its first document. The
+ * pool is allocated through realloc_fn, which jsmn_ctx_free() calls with size
+ * 0 to free it.
+ */
+JSMN_API void jsmn_ctx_init(jsmn_ctx *ctx, jsmn_realloc_t realloc_fn,
+                            void *user);
+
+/**
+ * Parses js into ctx->tokens like jsmn_parse_grow(), returning the number of
+ * tokens or an error. Call jsmn_ctx_reset() before each new document; calls
+ * in between continue the same one, as jsmn_parse() does.
+ */
+JSMN_API jsmnint_t jsmn_ctx_parse(jsmn_ctx *ctx, const char *js,
+                                  const size_t len);
+
+/**
+ * Starts a new document, dropping the tokens of the last one but keeping the
+ * pool, which may be trimmed as described above.
+ */
+JSMN_API void jsmn_ctx_reset(jsmn_ctx *ctx);
+
+/**
+ * Frees the pool. The context can be set up again with jsmn_ctx_init().
+ */
+JSMN_API void jsmn_ctx_free(jsmn_ctx *ctx);
+
+#ifndef JSMN_HEADER
+/**
+ * Creates a context without allocating.
+ */
+JSMN_API void jsmn_ctx_init(jsmn_ctx *ctx, jsmn_realloc_t realloc_fn,
+                            void *user) {
+  ctx->tokens = NULL;
+  ctx->num_tokens = 0;
+  ctx->high_water = 0;
+  ctx->documents = 0;
+  ctx->realloc_fn = realloc_fn;
+  ctx->user = user;
+  jsmn_init_stack(&ctx->parser, ctx->stack, JSMN_CTX_STACK);
+}
+
+/**
+ * Parses into the pool, growing it as needed.
+ */
+JSMN_API jsmnint_t jsmn_ctx_parse(jsmn_ctx *ctx, const char *js,
+                                  const size_t len) {
+  return jsmn_parse_grow(&ctx->parser, js, len, &ctx->tokens,
+                         &ctx->num_tokens, ctx->realloc_fn, ctx->user);
+}
+
+/**
+ * Resets the parser and applies the trim policy.
+ */
+JSMN_API void jsmn_ctx_reset(jsmn_ctx *ctx) {
+  if (ctx->parser.toknext > ctx->high_water) {
+    ctx->high_water = ctx->parser.toknext;
+  }
+  if (++ctx->documents >= JSMN_CTX_TRIM_INTERVAL) {
+    /* Leave room for twice the high water mark, and at least the 64 tokens
+     * that jsmn_parse_grow() starts with */
+    const jsmnuint_t keep = ctx->high_water < 32 ? 64 : ctx->high_water * 2;
+    if (ctx->num_tokens / 4 > ctx->high_water && keep < ctx->num_tokens) {
+      void *shrunk =
+          ctx->realloc_fn(ctx->tokens, (size_t)keep * sizeof(jsmntok_t),
+                          ctx->user);
+      /* Failing to shrink leaves the pool as it was */
+      if (shrunk != NULL) {
+        ctx->tokens = (jsmntok_t *)shrunk;
+        ctx->num_tokens = keep;
+      }
+    }
+    ctx->high_water = 0;
+    ctx->documents = 0;
+  }
+  jsmn_init_stack(&ctx->parser, ctx->stack, JSMN_CTX_STACK);
+}
+
+/**
+ * Hands the pool back to the allocator.
+ */
+JSMN_API void jsmn_ctx_free(jsmn_ctx *ctx) {
+  if (ctx->tokens != NULL) {
+    ctx->realloc_fn(ctx->tokens, 0, ctx->user);
+  }
+  ctx->tokens = NULL;
+  ctx->num_tokens = 0;
+}
+#endif /* JSMN_HEADER */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSMN_CTX_H */
@@ -0,0 +1,557 @@
+/*
+ * Parallel parsing of one large document whose top level is an array, such
+ * as a multi-gigabyte export. The input is cut into chunks at commas of the
+ * top-level array, and the chunks are parsed on separate threads into parts
+ * of one token array, which are then moved together. The result is the same
+ * as that of a sequential jsmn_parse_grow().
+ *
+ * To find the cuts, a prepass goes over every chunk in parallel, counting its
+ * unescaped quotes and brackets in each case of it starting inside a string
+ * or not. The quote parity of the chunks before a chunk then says which case
+ * holds, and their brackets at what depth it starts. The same pass counts the
+ * '[', '{', ',' and ':' outside strings, one before every token but the first
+ * in well-formed JSON, which bounds the room each chunk needs in the array.
+ *
+ * Each chunk after the first is parsed from the first top-level comma after
+ * its start. Should a parse not end on the comma where the next one starts,
+ * or need more room, which only happens for malformed input, the document is
+ * parsed again sequentially, so the result never depends on the cuts.
+ *
+ * The threads come from OpenMP: build with -fopenmp or /openmp. Without it,
+ * the chunks are parsed one after another. Like jsmn.h, define JSMN_HEADER in
+ * all but one file that includes it.
+ */
+#ifndef JSMN_PARALLEL_H
+#define JSMN_PARALLEL_H
+
+#include "jsmn.h"
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Most chunks a document is cut into */
+#ifndef JSMN_PARALLEL_MAX_CHUNKS
+#define JSMN_PARALLEL_MAX_CHUNKS 256
+#endif
+
+/* Fewest bytes per chunk; smaller documents get fewer chunks */
+#ifndef JSMN_PARALLEL_MIN_CHUNK
+#define JSMN_PARALLEL_MIN_CHUNK (1 << 16)
+#endif
+
+/**
+ * Parses js like jsmn_parse_grow() with a freshly initialized parser, cutting
+ * it into up to chunks pieces that are parsed in parallel if its top level is
+ * an array. Documents over INT_MAX bytes need JSMN_LARGE.
+ */
+JSMN_API jsmnint_t jsmn_parse_parallel(const char *js, const size_t len,
+                                       jsmntok_t **tokens,
+                                       jsmnuint_t *num_tokens,
+                                       const unsigned int chunks,
+                                       jsmn_realloc_t realloc_fn, void *user);
+
+#ifndef JSMN_HEADER
+/**
+ * One piece of the document.
+ */
+typedef struct jsmn_chunk {
+  size_t begin;        /* first byte, or the first byte after a comma */
+  size_t end;          /* byte after the last one, or after the next comma */
+  unsigned int quotes; /* unescaped quotes modulo 2, then whether begin is
+                          inside a string */
+  ptrdiff_t depth[2];  /* change of depth if it starts outside or inside a
+                          string, then the depth at begin */
+  size_t marks[2];     /* '[', '{', ',' and ':' outside strings in either
+                          case, then in the case that holds */
+  size_t skipped;      /* marks before the comma it was cut at */
+  jsmnuint_t first;    /* index of its room in the token array */
+  jsmnuint_t count;    /* size of that room, then tokens used */
+  jsmnint_t base;      /* index of its first token once joined */
+  jsmnint_t error;     /* parse result, or 1 to parse sequentially instead */
+} jsmn_chunk;
+
+/**
+ * Returns whether the quote at pos is escaped by an odd number of
+ * backslashes before it.
+ */
+static int jsmn_quote_escaped(const char *js, const size_t pos) {
+  size_t i = pos;
+  while (i > 0 && js[i - 1] == '\\') {
+    i--;
+  }
+  return (pos - i) & 1;
+}
+
+#ifdef JSMN_SSE2
+/**
+ * Returns a mask of the bytes in js[pos..pos+15] that are quotes, brackets,
+ * commas or colons. Setting bit 5 maps '[' and ']' onto '{' and '}'.
+ */
+static unsigned int jsmn_structure_stops(const char *js, const size_t pos) {
+  const __m128i b = _mm_loadu_si128((const __m128i *)(js + pos));
+  const __m128i lower = _mm_or_si128(b, _mm_set1_epi8(0x20));
+  __m128i stop = _mm_cmpeq_epi8(b, _mm_set1_epi8('\"'));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(lower, _mm_set1_epi8('{')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(lower, _mm_set1_epi8('}')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8(',')));
+  stop = _mm_or_si128(stop, _mm_cmpeq_epi8(b, _mm_set1_epi8(':')));
+  return (unsigned int)_mm_movemask_epi8(stop);
+}
+
+/**
+ * Adds up the byte counters of the block loop below.
+ */
+static size_t jsmn_byte_sum(const __m128i counters) {
+  const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+  return (size_t)_mm_cvtsi128_si32(sums) +
+         (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+/**
+ * Counts the unescaped quotes, brackets and marks of a chunk 16 bytes at a
+ * time from pos, given whether pos is inside a string in the case of the
+ * chunk starting outside one. Stops where fewer than 16 bytes remain, or
+ * sooner to empty its counters, and returns where.
+ */
+static size_t jsmn_prepass_blocks(const char *js, size_t pos,
+                                  unsigned int *in_string, jsmn_chunk *chunk) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+  /* Counters in 8-bit lanes of every open, close and mark, and of those
+   * outside strings in the case of the chunk starting outside one */
+  __m128i opens = zero, closes = zero, marks = zero;
+  __m128i opens_out = zero, closes_out = zero, marks_out = zero;
+  unsigned int blocks = 0;
+  for (;;) {
+    __m128i b, lower, quotes, inside, open, close, mark;
+    unsigned int suspects;
+    if (pos + 16 > chunk->end) {
+      break;
+    }
+    b = _mm_loadu_si128((const __m128i *)(js + pos));
+    quotes = _mm_cmpeq_epi8(b, _mm_set1_epi8('\"'));
+
+    /* Drop the quotes that backslashes escape, looking back only from the
+     * quotes that follow one */
+    suspects = (unsigned int)_mm_movemask_epi8(
+                   _mm_cmpeq_epi8(b, _mm_set1_epi8('\\')))
+               << 1;
+    if (pos > 0 && js[pos - 1] == '\\') {
+      suspects |= 1;
+    }
+    suspects &= (unsigned int)_mm_movemask_epi8(quotes);
+    if (suspects != 0) {
+      unsigned int escaped = 0;
+      __m128i drop;
+      do {
+        const unsigned int k = jsmn_first_bit(suspects);
+        if (jsmn_quote_escaped(js, pos + k)) {
+          escaped |= 1u << k;
+        }
+        suspects &= suspects - 1;
+      } while (suspects != 0);
+      /* Spread the 16 bits of escaped over the 16 bytes */
+      drop = _mm_cvtsi32_si128((int)escaped);
+      drop = _mm_unpacklo_epi8(drop, drop);
+      drop = _mm_unpacklo_epi16(drop, drop);
+      drop = _mm_unpacklo_epi32(drop, drop);
+      drop = _mm_and_si128(drop, _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 8,
+                                              4, 2, 1, (char)0x80, 0x40, 0x20,
+                                              0x10, 8, 4, 2, 1));
+      drop = _mm_cmpeq_epi8(drop, zero);
+      quotes = _mm_and_si128(quotes, drop);
+    }
+
+    /* A byte is inside a string after an odd number of quotes */
+    inside = _mm_xor_si128(quotes, _mm_slli_si128(quotes, 1));
+    inside = _mm_xor_si128(inside, _mm_slli_si128(inside, 2));
+    inside = _mm_xor_si128(inside, _mm_slli_si128(inside, 4));
+    inside = _mm_xor_si128(inside, _mm_slli_si128(inside, 8));
+    if (*in_string) {
+      inside = _mm_xor_si128(inside, ones);
+    }
+    *in_string = (unsigned int)_mm_movemask_epi8(inside) >> 15;
+
+    lower = _mm_or_si128(b, _mm_set1_epi8(0x20));
+    open = _mm_cmpeq_epi8(lower, _mm_set1_epi8('{'));
+    close = _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'));
+    mark = _mm_or_si128(open,
+                        _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8(',')),
+                                     _mm_cmpeq_epi8(b, _mm_set1_epi8(':'))));
+    opens = _mm_sub_epi8(opens, open);
+    closes = _mm_sub_epi8(closes, close);
+    marks = _mm_sub_epi8(marks, mark);
+    opens_out = _mm_sub_epi8(opens_out, _mm_andnot_si128(inside, open));
+    closes_out = _mm_sub_epi8(closes_out, _mm_andnot_si128(inside, close));
+    marks_out = _mm_sub_epi8(marks_out, _mm_andnot_si128(inside, mark));
+    pos += 16;
+
+    /* Empty the counters before they can overflow */
+    if (++blocks == 255) {
+      break;
+    }
+  }
+  chunk->depth[0] += (ptrdiff_t)jsmn_byte_sum(opens_out) -
+                     (ptrdiff_t)jsmn_byte_sum(closes_out);
+  chunk->depth[1] += (ptrdiff_t)(jsmn_byte_sum(opens) -
+                                 jsmn_byte_sum(opens_out)) -
+                     (ptrdiff_t)(jsmn_byte_sum(closes) -
+                                 jsmn_byte_sum(closes_out));
+  chunk->marks[0] += jsmn_byte_sum(marks_out);
+  chunk->marks[1] += jsmn_byte_sum(marks) - jsmn_byte_sum(marks_out);
+  return pos;
+}
+#endif
+
+/**
+ * Counts the unescaped quotes, brackets and marks of a chunk.
+ */
+static void jsmn_chunk_prepass(const char *js, jsmn_chunk *chunk) {
+  unsigned int in_string = 0;
+  size_t pos = chunk->begin;
+#ifdef JSMN_SSE2
+  while (pos + 16 <= chunk->end) {
+    pos = jsmn_prepass_blocks(js, pos, &in_string, chunk);
+  }
+#endif
+  for (; pos < chunk->end; pos++) {
+    switch (js[pos]) {
+    case '\"':
+      if (!jsmn_quote_escaped(js, pos)) {
+        in_string ^= 1;
+      }
+      break;
+    case '{':
+    case '[':
+      chunk->depth[in_string]++;
+      chunk->marks[in_string]++;
+      break;
+    case '}':
+    case ']':
+      chunk->depth[in_string]--;
+      break;
+    case ',':
+    case ':':
+      chunk->marks[in_string]++;
+      break;
+    default:
+      break;
+    }
+  }
+  chunk->quotes = in_string;
+}
+
+/**
+ * Moves the start of a chunk past the first comma of the top-level array in
+ * it, counting the marks it passes, or past its end if there is none.
+ */
+static void jsmn_chunk_cut(const char *js, jsmn_chunk *chunk) {
+  unsigned int in_string = chunk->quotes;
+  ptrdiff_t depth = chunk->depth[0];
+  size_t pos;
+  for (pos = chunk->begin; pos < chunk->end; pos++) {
+    char c;
+#ifdef JSMN_SSE2
+    pos = jsmn_skip(js, pos, chunk->end, jsmn_structure_stops);
+    if (pos == chunk->end) {
+      break;
+    }
+#endif
+    c = js[pos];
+    if (c == '\"') {
+      if (!jsmn_quote_escaped(js, pos)) {
+        in_string ^= 1;
+      }
+      continue;
+    }
+    if (in_string) {
+      continue;
+    }
+    switch (c) {
+    case '{':
+    case '[':
+      depth++;
+      chunk->skipped++;
+      break;
+    case '}':
+    case ']':
+      depth--;
+      break;
+    case ',':
+      if (depth == 1) {
+        chunk->begin = pos + 1;
+        return;
+      }
+      chunk->skipped++;
+      break;
+    case ':':
+      chunk->skipped++;
+      break;
+    default:
+      break;
+    }
+  }
+  chunk->begin = chunk->end + 1;
+}
+
+/**
+ * Parses one chunk into its room in the token array. All chunks but the first
+ * start right after a comma of the top-level array, so they are parsed as the
+ * rest of an array, which the first token of the room stands in for; all but
+ * the last must then end right after the next such comma, still in it.
+ */
+static void jsmn_parse_chunk(const char *js, jsmn_chunk *chunk,
+                             jsmntok_t *tokens, const int last) {
+  jsmn_parser parser;
+  jsmnint_t stack[64];
+  jsmnint_t r;
+
+  jsmn_init_stack(&parser, stack, sizeof(stack) / sizeof(stack[0]));
+  tokens += chunk->first;
+  if (chunk->first != 0) {
+    size_t pos = chunk->begin;
+
+    /* Outside of strict mode a ':' makes the token before it a key, and the
+     * stand-in is not that token */
+    while (pos < chunk->end && (js[pos] == ' ' || js[pos] == '\t' ||
+                                js[pos] == '\r' || js[pos] == '\n')) {
+      pos++;
+    }
+    if (pos < chunk->end && js[pos] == ':') {
+      chunk->error = 1;
+      return;
+    }
+    tokens[0].type = JSMN_ARRAY;
+    tokens[0].start = (jsmnint_t)chunk->begin - 1;
+    tokens[0].end = -1;
+    tokens[0].size = 0;
+#ifdef JSMN_PARENT_LINKS
+    tokens[0].parent = -1;
+#endif
+#ifdef JSMN_NEXT_LINKS
+    tokens[0].next = 1;
+#endif
+    parser.toknext = 1;
+    parser.toksuper = 0;
+    stack[0] = 0;
+    parser.depth = 1;
+#ifdef JSMN_VALIDATE
+    parser.expect = JSMN_EXPECT_VALUE;
+#endif
+  }
+  parser.pos = (jsmnuint_t)chunk->begin;
+  r = jsmn_parse(&parser, js, chunk->end, tokens, chunk->count);
+  chunk->count = parser.toknext;
+  if (r == JSMN_ERROR_NOMEM) {
+    chunk->error = 1;
+  } else if (last || (r < 0 && r != JSMN_ERROR_PART)) {
+    chunk->error = r < 0 ? r : 0;
+  } else {
+    chunk->error = r == JSMN_ERROR_PART && parser.pos == chunk->end &&
+                           parser.depth == 1 && parser.toksuper == 0
+#ifdef JSMN_VALIDATE
+                           && parser.expect == JSMN_EXPECT_VALUE
+#endif
+                       ? 0
+                       : 1;
+  }
+}
+
+/**
+ * Renumbers the links of a chunk after the first for its tokens to follow
+ * those of the chunks before it.
+ */
+static void jsmn_chunk_relink(const jsmn_chunk *chunk, jsmntok_t *tokens) {
+  const jsmnint_t shift = chunk->base - 1;
+  jsmnuint_t i;
+  for (i = 1; i < chunk->count; i++) {
+    jsmntok_t *token = &tokens[chunk->first + i];
+#ifdef JSMN_PARENT_LINKS
+    /* Children of the stand-in are children of the top-level array */
+    if (token->parent > 0) {
+      token->parent += shift;
+    }
+#endif
+#ifdef JSMN_NEXT_LINKS
+    token->next += shift;
+#endif
+    (void)token;
+    (void)shift;
+  }
+}
+
+/**
+ * Cuts the document, parses the chunks in parallel and joins their tokens.
+ */
+JSMN_API jsmnint_t jsmn_parse_parallel(const char *js, const size_t len,
+                                       jsmntok_t **tokens,
+                                       jsmnuint_t *num_tokens,
+                                       const unsigned int chunks,
+                                       jsmn_realloc_t realloc_fn, void *user) {
+  jsmn_chunk chunk[JSMN_PARALLEL_MAX_CHUNKS];
+  jsmn_parser parser;
+  jsmnint_t stack[64];
+  jsmntok_t *last;
+  size_t start = 0;
+  size_t room;
+  size_t count;
+  size_t size;
+  unsigned int in_string = 0;
+  ptrdiff_t depth = 0;
+  int n = (int)(chunks < JSMN_PARALLEL_MAX_CHUNKS ? chunks
+                                                  : JSMN_PARALLEL_MAX_CHUNKS);
+  int m;
+  int k;
+
+  /* Only a top-level array is cut, and only into chunks worth a thread */
+  while (start < len && (js[start] == ' ' || js[start] == '\t' ||
+                         js[start] == '\r' || js[start] == '\n')) {
+    start++;
+  }
+  if ((size_t)n > len / JSMN_PARALLEL_MIN_CHUNK) {
+    n = (int)(len / JSMN_PARALLEL_MIN_CHUNK);
+  }
+  if (n < 2 || start == len || js[start] != '[') {
+    goto sequential;
+  }
+
+  memset(chunk, 0, sizeof(chunk));
+  for (k = 0; k < n; k++) {
+    chunk[k].begin = len / (size_t)n * (size_t)k;
+    chunk[k].end = k == n - 1 ? len : len / (size_t)n * (size_t)(k + 1);
+  }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (k = 0; k < n; k++) {
+    jsmn_chunk_prepass(js, &chunk[k]);
+  }
+
+  /* Settle which case holds for each chunk from the ones before it */
+  for (k = 0; k < n; k++) {
+    const unsigned int quotes = chunk[k].quotes;
+    const ptrdiff_t change = chunk[k].depth[in_string];
+    chunk[k].marks[0] = chunk[k].marks[in_string];
+    chunk[k].quotes = in_string;
+    chunk[k].depth[0] = depth;
+    in_string ^= quotes;
+    depth += change;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (k = 1; k < n; k++) {
+    jsmn_chunk_cut(js, &chunk[k]);
+  }
+
+  /* Merge each chunk without a cut into the one before it. A chunk needs
+   * room for a token after each mark from the comma it was cut at up to the
+   * next cut, and for the top-level array or its stand-in */
+  room = 1 + chunk[0].marks[0];
+  for (k = 1, m = 1; k < n; k++) {
+    if (chunk[k].begin > chunk[k].end) {
+      room += chunk[k].marks[0];
+      continue;
+    }
+    chunk[m - 1].end = chunk[k].begin;
+    chunk[m - 1].count = (jsmnuint_t)(room + chunk[k].skipped);
+    chunk[m].begin = chunk[k].begin;
+    room = 1 + chunk[k].marks[0] - chunk[k].skipped;
+    m++;
+  }
+  chunk[m - 1].end = len;
+  chunk[m - 1].count = (jsmnuint_t)room;
+  if (m < 2) {
+    goto sequential;
+  }
+
+  /* Lay the rooms out one after another in the token array */
+  room = 0;
+  for (k = 0; k < m; k++) {
+    chunk[k].first = (jsmnuint_t)room;
+    room += chunk[k].count;
+    if (room > (size_t)((jsmnuint_t)-1 >> 1)) {
+      goto sequential;
+    }
+  }
+  if (room > *num_tokens) {
+    void *grown;
+    if (room > (size_t)-1 / sizeof(jsmntok_t)) {
+      return JSMN_ERROR_NOMEM;
+    }
+    grown = realloc_fn(*tokens, room * sizeof(jsmntok_t), user);
+    if (grown == NULL) {
+      return JSMN_ERROR_NOMEM;
+    }
+    *tokens = (jsmntok_t *)grown;
+    *num_tokens = (jsmnuint_t)room;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (k = 0; k < m; k++) {
+    jsmn_parse_chunk(js, &chunk[k], *tokens, k == m - 1);
+  }
+
+  /* The first chunk whose parse went wrong decides: a real error is the one
+   * a sequential parse would meet; otherwise the cuts were misled */
+  for (k = 0; k < m; k++) {
+    if (chunk[k].error < 0) {
+      return chunk[k].error;
+    }
+    if (chunk[k].error > 0) {
+      goto sequential;
+    }
+  }
+
+  count = chunk[0].count;
+  size = (size_t)(*tokens)[0].size;
+  for (k = 1; k < m; k++) {
+    chunk[k].base = (jsmnint_t)count;
+    count += chunk[k].count - 1;
+    size += (size_t)(*tokens)[chunk[k].first].size;
+  }
+#ifdef JSMN_COMPACT
+  if (size > JSMN_COMPACT_MAX_SIZE) {
+    return JSMN_ERROR_LIMIT;
+  }
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+  for (k = 1; k < m; k++) {
+    jsmn_chunk_relink(&chunk[k], *tokens);
+  }
+
+  /* The stand-in of the last chunk was closed where the array ends */
+  last = &(*tokens)[chunk[m - 1].first];
+  (*tokens)[0].size = (jsmnint_t)size;
+  (*tokens)[0].end = last->end;
+#ifdef JSMN_NEXT_LINKS
+  (*tokens)[0].next = last->next + chunk[m - 1].base - 1;
+#endif
+
+  /* Move the tokens of each chunk behind those of the one before it, leaving
+   * out the stand-ins */
+  for (k = 1; k < m; k++) {
+    memmove(*tokens + chunk[k].base, *tokens + chunk[k].first + 1,
+            (chunk[k].count - 1) * sizeof(jsmntok_t));
+  }
+  return (jsmnint_t)count;
+
+sequential:
+  jsmn_init_stack(&parser, stack, sizeof(stack) / sizeof(stack[0]));
+  return jsmn_parse_grow(&parser, js, len, tokens, num_tokens, realloc_fn,
+                         user);
+}
+#endif /* JSMN_HEADER */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSMN_PARALLEL_H */
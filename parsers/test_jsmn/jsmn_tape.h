@@ -0,0 +1,213 @@
+/*
+ * Navigation over the token array that jsmn_parse() fills, using the next
+ * links of JSMN_NEXT_LINKS: stepping over a value, looking up an object
+ * member or an array element, and resolving JSON Pointers (RFC 6901) such as
+ * "/a/b/3". Each step over a sibling is one jump, however large the sibling.
+ *
+ * The tokens must come from a jsmn_parse() call that succeeded, and js is the
+ * JSON string their offsets refer to. Keys are compared as they appear in js,
+ * without decoding escape sequences.
+ *
+ * Like jsmn.h, define JSMN_HEADER in all but one file that includes it, and
+ * define JSMN_NEXT_LINKS for every file that includes jsmn.h.
+ */
+#ifndef JSMN_TAPE_H
+#define JSMN_TAPE_H
+
+#ifndef JSMN_NEXT_LINKS
+#define JSMN_NEXT_LINKS
+#endif
+#include "jsmn.h"
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the index of the token after the value at index i and everything
+ * inside it. For an object key, that steps over its value too; outside of
+ * strict mode a member may also be a lone string, which has no value.
+ */
+JSMN_API jsmnint_t jsmn_skip_token(const jsmntok_t *tokens, const jsmnint_t i);
+
+/**
+ * Returns the index of the value of the member of the object at index object
+ * whose key is the key_len bytes at key, or -1 if there is none.
+ */
+JSMN_API jsmnint_t jsmn_object_get(const char *js, const jsmntok_t *tokens,
+                                   const jsmnint_t object, const char *key,
+                                   const size_t key_len);
+
+/**
+ * Returns the index of element n of the array at index array, or -1 if it
+ * has fewer elements.
+ */
+JSMN_API jsmnint_t jsmn_array_at(const jsmntok_t *tokens,
+                                 const jsmnint_t array, const jsmnuint_t n);
+
+/**
+ * Stores the token indices of the first n elements of the array at index
+ * array in index, and returns how many it stored. Stepping to element n with
+ * jsmn_array_at() takes n jumps, which add up over a large array; with the
+ * indices, each element is one lookup away.
+ */
+JSMN_API jsmnuint_t jsmn_array_index(const jsmntok_t *tokens,
+                                     const jsmnint_t array, jsmnint_t *index,
+                                     const jsmnuint_t n);
+
+/**
+ * Returns the index of the value that the JSON Pointer path selects, starting
+ * from the value at index root, or -1 if it selects nothing. The empty path
+ * selects root itself.
+ */
+JSMN_API jsmnint_t jsmn_query(const char *js, const jsmntok_t *tokens,
+                              const jsmnint_t root, const char *path);
+
+#ifndef JSMN_HEADER
+/**
+ * Steps over a value.
+ */
+JSMN_API jsmnint_t jsmn_skip_token(const jsmntok_t *tokens,
+                                   const jsmnint_t i) {
+  /* Only a key has a size among strings and primitives */
+  if ((tokens[i].type == JSMN_STRING || tokens[i].type == JSMN_PRIMITIVE) &&
+      tokens[i].size != 0) {
+    return tokens[tokens[i].next].next;
+  }
+  return tokens[i].next;
+}
+
+/**
+ * Finds an object member by key.
+ */
+JSMN_API jsmnint_t jsmn_object_get(const char *js, const jsmntok_t *tokens,
+                                   const jsmnint_t object, const char *key,
+                                   const size_t key_len) {
+  jsmnint_t i = object + 1;
+  jsmnint_t n;
+  if (tokens[object].type != JSMN_OBJECT) {
+    return -1;
+  }
+  for (n = tokens[object].size; n > 0; n--) {
+    if ((size_t)(tokens[i].end - tokens[i].start) == key_len &&
+        memcmp(js + tokens[i].start, key, key_len) == 0) {
+      return tokens[i].size != 0 ? i + 1 : -1;
+    }
+    i = jsmn_skip_token(tokens, i);
+  }
+  return -1;
+}
+
+/**
+ * Finds an array element by position.
+ */
+JSMN_API jsmnint_t jsmn_array_at(const jsmntok_t *tokens,
+                                 const jsmnint_t array, const jsmnuint_t n) {
+  jsmnint_t i = array + 1;
+  jsmnuint_t k;
+  if (tokens[array].type != JSMN_ARRAY ||
+      n >= (jsmnuint_t)tokens[array].size) {
+    return -1;
+  }
+  for (k = 0; k < n; k++) {
+    i = tokens[i].next;
+  }
+  return i;
+}
+
+/**
+ * Lists the elements of an array.
+ */
+JSMN_API jsmnuint_t jsmn_array_index(const jsmntok_t *tokens,
+                                     const jsmnint_t array, jsmnint_t *index,
+                                     const jsmnuint_t n) {
+  jsmnint_t i = array + 1;
+  jsmnuint_t k;
+  if (tokens[array].type != JSMN_ARRAY) {
+    return 0;
+  }
+  for (k = 0; k < n && k < (jsmnuint_t)tokens[array].size; k++) {
+    index[k] = i;
+    i = tokens[i].next;
+  }
+  return k;
+}
+
+/**
+ * Returns whether a key matches a reference token, in which ~0 stands for ~
+ * and ~1 for /.
+ */
+static int jsmn_pointer_eq(const char *key, const char *key_end,
+                           const char *ref, const char *ref_end) {
+  for (; ref != ref_end; ref++, key++) {
+    char c = *ref;
+    if (c == '~') {
+      if (++ref == ref_end || (*ref != '0' && *ref != '1')) {
+        return 0;
+      }
+      c = *ref == '0' ? '~' : '/';
+    }
+    if (key == key_end || *key != c) {
+      return 0;
+    }
+  }
+  return key == key_end;
+}
+
+/**
+ * Resolves a JSON Pointer one reference token at a time.
+ */
+JSMN_API jsmnint_t jsmn_query(const char *js, const jsmntok_t *tokens,
+                              const jsmnint_t root, const char *path) {
+  jsmnint_t i = root;
+  while (*path == '/') {
+    const char *ref = ++path;
+    jsmnint_t n;
+    while (*path != '/' && *path != '\0') {
+      path++;
+    }
+    if (tokens[i].type == JSMN_OBJECT) {
+      jsmnint_t k = i + 1;
+      for (n = tokens[i].size; n > 0; n--) {
+        if (jsmn_pointer_eq(js + tokens[k].start, js + tokens[k].end, ref,
+                            path)) {
+          break;
+        }
+        k = jsmn_skip_token(tokens, k);
+      }
+      if (n == 0 || tokens[k].size == 0) {
+        return -1;
+      }
+      i = k + 1;
+    } else if (tokens[i].type == JSMN_ARRAY) {
+      /* An array index is "0" or a decimal number without leading zeros */
+      jsmnuint_t index = 0;
+      if (ref == path || (*ref == '0' && path - ref > 1)) {
+        return -1;
+      }
+      for (; ref != path; ref++) {
+        if (*ref < '0' || *ref > '9' ||
+            index > ((jsmnuint_t)-1 - 9) / 10) {
+          return -1;
+        }
+        index = index * 10 + (jsmnuint_t)(*ref - '0');
+      }
+      i = jsmn_array_at(tokens, i, index);
+      if (i == -1) {
+        return -1;
+      }
+    } else {
+      return -1;
+    }
+  }
+  return *path == '\0' ? i : -1;
+}
+#endif /* JSMN_HEADER */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSMN_TAPE_H */
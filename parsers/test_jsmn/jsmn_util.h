@@ -0,0 +1,504 @@
+/*
+ * Conversions of the tokens that jsmn_parse() fills, without allocating:
+ * integers and doubles from primitives, the text of strings with their escape
+ * sequences decoded, and comparison of a decoded string with a key.
+ *
+ * The number conversions accept exactly the JSON number grammar and do not
+ * depend on the locale. jsmn_tok_to_double() rounds correctly: most numbers
+ * take an exact fast path, and the rest go to strtod() rewritten without a
+ * decimal point.
+ *
+ * Like jsmn.h, define JSMN_HEADER in all but one file that includes it.
+ */
+#ifndef JSMN_UTIL_H
+#define JSMN_UTIL_H
+
+#include "jsmn.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Stores the value of the integer primitive tok in value. Returns 0, or
+ * JSMN_ERROR_INVAL if tok is not a JSON number without a fraction or exponent,
+ * or JSMN_ERROR_LIMIT if it does not fit.
+ */
+JSMN_API jsmnint_t jsmn_tok_to_i64(const char *js, const jsmntok_t *tok,
+                                   int64_t *value);
+
+/**
+ * Stores the value of the number primitive tok in value, correctly rounded.
+ * Returns 0, or JSMN_ERROR_INVAL if tok is not a JSON number, or
+ * JSMN_ERROR_LIMIT if it is too large for a double, which leaves an infinity
+ * in value.
+ */
+JSMN_API jsmnint_t jsmn_tok_to_double(const char *js, const jsmntok_t *tok,
+                                      double *value);
+
+/**
+ * Writes the text of the string tok with its escape sequences decoded to out,
+ * which has room for out_len bytes, and returns its length. The text is never
+ * longer than the token, and out may be js + tok->start to decode in place.
+ * Other tokens are copied as they are. No NUL is added. Returns
+ * JSMN_ERROR_NOMEM if out is too small, or JSMN_ERROR_INVAL for a malformed
+ * escape sequence. An unpaired surrogate decodes to U+FFFD.
+ */
+JSMN_API jsmnint_t jsmn_tok_unescape_into(const char *js, const jsmntok_t *tok,
+                                          char *out, const size_t out_len);
+
+/**
+ * Returns whether the text of tok, decoded as jsmn_tok_unescape_into() would,
+ * is the len bytes at s.
+ */
+JSMN_API int jsmn_tok_eq(const char *js, const jsmntok_t *tok, const char *s,
+                         const size_t len);
+
+#ifndef JSMN_HEADER
+/* Significant digits passed to strtod(); beyond the 767 that can decide the
+ * rounding of a double, the rest only matter as a whole */
+#define JSMN_DOUBLE_DIGITS 800
+
+/* Decimal exponents past this are infinity or zero whatever the digits */
+#define JSMN_DOUBLE_EXPONENT 100000
+
+/* The fast path of jsmn_tok_to_double() needs each operation on doubles
+ * rounded once, to double; x87 code keeps wider intermediates */
+#ifdef FLT_EVAL_METHOD
+#if FLT_EVAL_METHOD == 0
+#define JSMN_DOUBLE_FAST_PATH
+#endif
+#elif !defined(__FLT_EVAL_METHOD__) || __FLT_EVAL_METHOD__ == 0
+#define JSMN_DOUBLE_FAST_PATH
+#endif
+
+/**
+ * Stores the integer.
+ */
+JSMN_API jsmnint_t jsmn_tok_to_i64(const char *js, const jsmntok_t *tok,
+                                   int64_t *value) {
+  const char *p = js + tok->start;
+  const char *end = js + tok->end;
+  uint64_t limit = ((uint64_t)1 << 63) - 1;
+  uint64_t n = 0;
+  int negative = 0;
+  if (tok->type != JSMN_PRIMITIVE) {
+    return JSMN_ERROR_INVAL;
+  }
+  if (p != end && *p == '-') {
+    negative = 1;
+    limit++;
+    p++;
+  }
+  if (p == end || (*p == '0' && end - p > 1)) {
+    return JSMN_ERROR_INVAL;
+  }
+  for (; p != end; p++) {
+    const unsigned int d = (unsigned int)(unsigned char)*p - '0';
+    if (d > 9) {
+      return JSMN_ERROR_INVAL;
+    }
+    if (n >= limit / 10 && (n > limit / 10 || d > limit % 10)) {
+      /* Keep checking the rest, which may not be a number at all */
+      for (p++; p != end; p++) {
+        if (*p < '0' || *p > '9') {
+          return JSMN_ERROR_INVAL;
+        }
+      }
+      return JSMN_ERROR_LIMIT;
+    }
+    n = n * 10 + d;
+  }
+  *value = negative && n != 0 ? -(int64_t)(n - 1) - 1 : (int64_t)n;
+  return 0;
+}
+
+/**
+ * Converts the number the slow way: its significant digits and decimal
+ * exponent are written out as "-DDDDe-NN" for strtod(), which in that form
+ * reads the same in every locale.
+ */
+static double jsmn_strtod(const char *p, const char *end, const int negative,
+                          long exponent) {
+  char buf[JSMN_DOUBLE_DIGITS + 16];
+  char digits[16];
+  size_t n = 0;
+  size_t kept = 0;
+  int fraction = 0;
+  int sticky = 0;
+  unsigned long e;
+  if (negative) {
+    buf[n++] = '-';
+  }
+  for (; p != end && *p != 'e' && *p != 'E'; p++) {
+    if (*p == '.') {
+      fraction = 1;
+    } else if (kept == 0 && *p == '0') {
+      exponent -= fraction;
+    } else if (kept < JSMN_DOUBLE_DIGITS) {
+      buf[n++] = *p;
+      kept++;
+      exponent -= fraction;
+    } else {
+      exponent += !fraction;
+      sticky |= *p != '0';
+    }
+  }
+  /* One more nonzero digit stands in for the nonzero ones dropped */
+  if (sticky) {
+    buf[n++] = '1';
+    exponent--;
+  }
+  if (exponent > JSMN_DOUBLE_EXPONENT) {
+    exponent = JSMN_DOUBLE_EXPONENT;
+  } else if (exponent < -JSMN_DOUBLE_EXPONENT) {
+    exponent = -JSMN_DOUBLE_EXPONENT;
+  }
+  buf[n++] = 'e';
+  if (exponent < 0) {
+    buf[n++] = '-';
+  }
+  e = (unsigned long)(exponent < 0 ? -exponent : exponent);
+  kept = 0;
+  do {
+    digits[kept++] = (char)('0' + e % 10);
+    e /= 10;
+  } while (e != 0);
+  while (kept > 0) {
+    buf[n++] = digits[--kept];
+  }
+  buf[n] = '\0';
+  return strtod(buf, NULL);
+}
+
+/**
+ * Converts a number, exactly where its significant digits fit in 53 bits and
+ * its power of ten is exact in a double too (Clinger's fast path), or where
+ * it is an integer of up to 19 digits.
+ */
+JSMN_API jsmnint_t jsmn_tok_to_double(const char *js, const jsmntok_t *tok,
+                                      double *value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *p = js + tok->start;
+  const char *end = js + tok->end;
+  const char *digits;
+  uint64_t mantissa = 0;
+  long exponent = 0;
+  long e = 0;
+  int kept = 0;
+  int truncated = 0;
+  int negative = 0;
+  int fraction = 0;
+  if (tok->type != JSMN_PRIMITIVE) {
+    return JSMN_ERROR_INVAL;
+  }
+  if (p != end && *p == '-') {
+    negative = 1;
+    p++;
+  }
+  digits = p;
+
+  /* Integer part, without leading zeros, then the fraction. The first 19
+   * significant digits go into mantissa and exponent scales them */
+  if (p == end || *p < '0' || *p > '9' ||
+      (*p == '0' && p + 1 != end && p[1] >= '0' && p[1] <= '9')) {
+    return JSMN_ERROR_INVAL;
+  }
+  for (;;) {
+    for (; p != end && *p >= '0' && *p <= '9'; p++) {
+      const unsigned int d = (unsigned int)(*p - '0');
+      if (kept < 19) {
+        if (mantissa != 0 || d != 0) {
+          mantissa = mantissa * 10 + d;
+          kept++;
+        }
+        exponent -= fraction;
+      } else {
+        exponent += !fraction;
+        truncated = 1;
+      }
+    }
+    if (fraction || p == end || *p != '.') {
+      break;
+    }
+    fraction = 1;
+    if (++p == end || *p < '0' || *p > '9') {
+      return JSMN_ERROR_INVAL;
+    }
+  }
+
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    int negative_e = 0;
+    if (++p != end && (*p == '-' || *p == '+')) {
+      negative_e = *p == '-';
+      p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+      return JSMN_ERROR_INVAL;
+    }
+    for (; p != end && *p >= '0' && *p <= '9'; p++) {
+      if (e < JSMN_DOUBLE_EXPONENT) {
+        e = e * 10 + (*p - '0');
+      }
+    }
+    if (negative_e) {
+      e = -e;
+    }
+  }
+  if (p != end) {
+    return JSMN_ERROR_INVAL;
+  }
+
+#ifdef JSMN_DOUBLE_FAST_PATH
+  /* Past 53 bits, the conversion of mantissa is the one rounding, so it can
+   * only stand on its own */
+  if (!truncated &&
+      (mantissa <= (uint64_t)1 << 53 || exponent + e == 0)) {
+    double d = (double)mantissa;
+    const long total = exponent + e;
+    if (total >= 0 && total <= 22) {
+      d *= powers[total];
+    } else if (total < 0 && total >= -22) {
+      d /= powers[-total];
+    } else if (total > 22 && total <= 22 + 15) {
+      /* Move the excess into the mantissa while it stays exact */
+      long k;
+      for (k = total - 22; k > 0 && mantissa <= ((uint64_t)1 << 53) / 10;
+           k--) {
+        mantissa *= 10;
+      }
+      if (k != 0) {
+        goto slow;
+      }
+      d = (double)mantissa * 1e22;
+    } else {
+      goto slow;
+    }
+    *value = negative ? -d : d;
+    return 0;
+  }
+slow:
+#endif
+  if (mantissa == 0) {
+    *value = negative ? -0.0 : 0.0;
+    return 0;
+  }
+  *value = jsmn_strtod(digits, end, negative, e);
+  return *value == HUGE_VAL || *value == -HUGE_VAL ? JSMN_ERROR_LIMIT : 0;
+}
+
+#ifdef JSMN_SSE2
+/**
+ * Returns a mask of the backslashes in js[pos..pos+15].
+ */
+static unsigned int jsmn_backslash_stops(const char *js, const size_t pos) {
+  const __m128i b = _mm_loadu_si128((const __m128i *)(js + pos));
+  return (unsigned int)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(b, _mm_set1_epi8('\\')));
+}
+#endif
+
+/**
+ * Returns the first backslash from p on, or end if there is none.
+ */
+static const char *jsmn_find_backslash(const char *js, const char *p,
+                                       const char *end) {
+#ifdef JSMN_SSE2
+  p = js + jsmn_skip(js, (size_t)(p - js), (size_t)(end - js),
+                     jsmn_backslash_stops);
+#else
+  (void)js;
+#endif
+  while (p != end && *p != '\\') {
+    p++;
+  }
+  return p;
+}
+
+/**
+ * Returns the value of four hex digits, or -1 if they are not.
+ */
+static long jsmn_hex4(const char *p) {
+  long value = 0;
+  int i;
+  for (i = 0; i < 4; i++) {
+    const char c = p[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else {
+      return -1;
+    }
+  }
+  return value;
+}
+
+/**
+ * Decodes the escape sequence at *p into out, which has room for 4 bytes,
+ * and moves *p past it. Returns the number of bytes, or -1 if it is malformed.
+ * No sequence decodes to more bytes than it takes up.
+ */
+static int jsmn_unescape_char(const char **p, const char *end, char *out) {
+  const char *s = *p;
+  long cp;
+  if (end - s < 2) {
+    return -1;
+  }
+  *p = s + 2;
+  switch (s[1]) {
+  case '\"':
+  case '/':
+  case '\\':
+    out[0] = s[1];
+    return 1;
+  case 'b':
+    out[0] = '\b';
+    return 1;
+  case 'f':
+    out[0] = '\f';
+    return 1;
+  case 'n':
+    out[0] = '\n';
+    return 1;
+  case 'r':
+    out[0] = '\r';
+    return 1;
+  case 't':
+    out[0] = '\t';
+    return 1;
+  case 'u':
+    break;
+  default:
+    return -1;
+  }
+  if (end - s < 6 || (cp = jsmn_hex4(s + 2)) < 0) {
+    return -1;
+  }
+  *p = s + 6;
+  if (cp >= 0xD800 && cp <= 0xDFFF) {
+    long low;
+    if (cp <= 0xDBFF && end - s >= 12 && s[6] == '\\' && s[7] == 'u' &&
+        (low = jsmn_hex4(s + 8)) >= 0xDC00 && low <= 0xDFFF) {
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+      *p = s + 12;
+    } else {
+      cp = 0xFFFD;
+    }
+  }
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xC0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (cp >> 18));
+  out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/**
+ * Copies the runs between escape sequences with memmove(), which also covers
+ * decoding in place, and decodes the sequences one by one.
+ */
+JSMN_API jsmnint_t jsmn_tok_unescape_into(const char *js, const jsmntok_t *tok,
+                                          char *out, const size_t out_len) {
+  const char *p = js + tok->start;
+  const char *end = js + tok->end;
+  size_t n = 0;
+  while (p != end) {
+    const char *run = p;
+    size_t len;
+    p = tok->type == JSMN_STRING ? jsmn_find_backslash(js, p, end) : end;
+    len = (size_t)(p - run);
+    if (len > out_len - n) {
+      return JSMN_ERROR_NOMEM;
+    }
+    if (out + n != run) {
+      memmove(out + n, run, len);
+    }
+    n += len;
+    if (p != end) {
+      char c[4];
+      const int k = jsmn_unescape_char(&p, end, c);
+      if (k < 0) {
+        return JSMN_ERROR_INVAL;
+      }
+      if ((size_t)k > out_len - n) {
+        return JSMN_ERROR_NOMEM;
+      }
+      memcpy(out + n, c, (size_t)k);
+      n += (size_t)k;
+    }
+  }
+  return (jsmnint_t)n;
+}
+
+/**
+ * Compares the runs between escape sequences directly and the sequences one
+ * by one as they decode.
+ */
+JSMN_API int jsmn_tok_eq(const char *js, const jsmntok_t *tok, const char *s,
+                         const size_t len) {
+  const char *p = js + tok->start;
+  const char *end = js + tok->end;
+  const char *q = s;
+  const char *q_end = s + len;
+  if (tok->type != JSMN_STRING) {
+    return (size_t)(end - p) == len && memcmp(p, s, len) == 0;
+  }
+  /* Decoding never makes a string longer */
+  if ((size_t)(end - p) < len) {
+    return 0;
+  }
+  while (p != end) {
+    const char *run = p;
+    size_t n;
+    p = jsmn_find_backslash(js, p, end);
+    n = (size_t)(p - run);
+    if (n > (size_t)(q_end - q) || memcmp(run, q, n) != 0) {
+      return 0;
+    }
+    q += n;
+    if (p != end) {
+      char c[4];
+      const int k = jsmn_unescape_char(&p, end, c);
+      if (k < 0 || (size_t)k > (size_t)(q_end - q) ||
+          memcmp(c, q, (size_t)k) != 0) {
+        return 0;
+      }
+      q += k;
+    }
+  }
+  return q == q_end;
+}
+#endif /* JSMN_HEADER */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSMN_UTIL_H */
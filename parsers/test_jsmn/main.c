@@ -1,3 +1,5 @@
+/* Accept exactly RFC 8259 JSON, as the test cases expect */
+#define JSMN_VALIDATE
 #include "jsmn.h"
 
 #include <stdio.h>
@@ -9,6 +11,12 @@ int usage()
 	return 1;
 }
 
+void* grow_tokens(void* ptr, size_t size, void* user)
+{
+	(void)user;
+	return realloc(ptr, size);
+}
+
 int main(int argc, char* argv[])
 {
 	if (argc != 2) return usage();
@@ -26,12 +34,15 @@ int main(int argc, char* argv[])
 	fclose(file);
 
 	jsmn_parser parser;
-	jsmn_init(&parser);
-	jsmntok_t tokens[1 << 15];
-	int count = jsmn_parse(&parser, buffer, size, tokens, sizeof(tokens) / sizeof(tokens[0]));
+	jsmnint_t stack[256];
+	jsmn_init_stack(&parser, stack, sizeof(stack) / sizeof(stack[0]));
+	jsmntok_t* tokens = NULL;
+	jsmnuint_t num_tokens = 0;
+	jsmnint_t count = jsmn_parse_grow(&parser, buffer, size, &tokens, &num_tokens, grow_tokens, NULL);
+	free(tokens);
 	if (count < 0)
 	{
-		fprintf(stderr, "Failed to parse JSON: %d", count);
+		fprintf(stderr, "Failed to parse JSON: %d", (int)count);
 		free(buffer);
 		return 1;
 	}
@@ -20,19 +20,43 @@
  */
 
 #include "json11.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <iterator>
 #include <limits>
+#include <stdexcept>
+#include <thread>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+    #if __has_include(<charconv>)
+        #include <charconv>
+    #endif
+#endif
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    #define JSON11_HAS_TO_CHARS 1
+#else
+    #define JSON11_HAS_TO_CHARS 0
+#endif
+
+#if !defined(JSON11_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) \
+                                 || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define JSON11_HAS_SSE2 1
+#else
+    #define JSON11_HAS_SSE2 0
+#endif
 
 namespace json11 {
 
-static const int max_depth = 200;
-
 using std::string;
 using std::vector;
-using std::map;
 using std::make_shared;
 using std::initializer_list;
 using std::move;
@@ -57,8 +81,12 @@ static void dump(NullStruct, string &out) {
 static void dump(double value, string &out) {
     if (std::isfinite(value)) {
         char buf[32];
-        snprintf(buf, sizeof buf, "%.17g", value);
-        out += buf;
+#if JSON11_HAS_TO_CHARS
+        // Shortest representation that reads back as the same double.
+        out.append(buf, std::to_chars(buf, buf + sizeof buf, value).ptr);
+#else
+        out.append(buf, snprintf(buf, sizeof buf, "%.17g", value));
+#endif
     } else {
         out += "null";
     }
@@ -66,48 +94,77 @@ static void dump(double value, string &out) {
 
 static void dump(int value, string &out) {
     char buf[32];
-    snprintf(buf, sizeof buf, "%d", value);
-    out += buf;
+#if JSON11_HAS_TO_CHARS
+    out.append(buf, std::to_chars(buf, buf + sizeof buf, value).ptr);
+#else
+    out.append(buf, snprintf(buf, sizeof buf, "%d", value));
+#endif
 }
 
 static void dump(bool value, string &out) {
     out += value ? "true" : "false";
 }
 
+/* EscapeTable
+ *
+ * How dump(string) treats each byte: 0 to copy it as-is, the letter that follows the
+ * backslash for a short escape, 'u' for a \u00XX escape, or 0xe2 for the lead byte of
+ * U+2028 and U+2029, which are escaped for the benefit of JavaScript consumers.
+ */
+struct EscapeTable {
+    uint8_t cls[256];
+    EscapeTable() {
+        for (int c = 0; c < 256; c++)
+            cls[c] = c <= 0x1f ? 'u' : 0;
+        cls[static_cast<uint8_t>('"')] = '"';
+        cls[static_cast<uint8_t>('\\')] = '\\';
+        cls[static_cast<uint8_t>('\b')] = 'b';
+        cls[static_cast<uint8_t>('\f')] = 'f';
+        cls[static_cast<uint8_t>('\n')] = 'n';
+        cls[static_cast<uint8_t>('\r')] = 'r';
+        cls[static_cast<uint8_t>('\t')] = 't';
+        cls[0xe2] = 0xe2;
+    }
+};
+
 static void dump(const string &value, string &out) {
+    static const EscapeTable escapes;
+    static const char hex[] = "0123456789abcdef";
+
+    const char *data = value.data();
+    const size_t len = value.size();
+
+    // Grow once for the common case of a string with nothing to escape.
+    if (out.capacity() - out.size() < len + 2)
+        out.reserve(std::max(out.size() + len + 2, 2 * out.capacity()));
+
     out += '"';
-    for (size_t i = 0; i < value.length(); i++) {
-        const char ch = value[i];
-        if (ch == '\\') {
-            out += "\\\\";
-        } else if (ch == '"') {
-            out += "\\\"";
-        } else if (ch == '\b') {
-            out += "\\b";
-        } else if (ch == '\f') {
-            out += "\\f";
-        } else if (ch == '\n') {
-            out += "\\n";
-        } else if (ch == '\r') {
-            out += "\\r";
-        } else if (ch == '\t') {
-            out += "\\t";
-        } else if (static_cast<uint8_t>(ch) <= 0x1f) {
-            char buf[8];
-            snprintf(buf, sizeof buf, "\\u%04x", ch);
-            out += buf;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                   && static_cast<uint8_t>(value[i+2]) == 0xa8) {
-            out += "\\u2028";
-            i += 2;
-        } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(value[i+1]) == 0x80
-                   && static_cast<uint8_t>(value[i+2]) == 0xa9) {
-            out += "\\u2029";
+    size_t run = 0;     // start of the bytes not yet copied
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t cls = escapes.cls[static_cast<uint8_t>(data[i])];
+        if (cls == 0)
+            continue;
+
+        if (cls == 0xe2) {
+            if (i + 2 >= len || static_cast<uint8_t>(data[i+1]) != 0x80
+                    || (static_cast<uint8_t>(data[i+2]) != 0xa8
+                        && static_cast<uint8_t>(data[i+2]) != 0xa9))
+                continue;
+            out.append(data + run, i - run);
+            out += static_cast<uint8_t>(data[i+2]) == 0xa8 ? "\\u2028" : "\\u2029";
             i += 2;
+        } else if (cls == 'u') {
+            out.append(data + run, i - run);
+            const char buf[6] = { '\\', 'u', '0', '0', hex[(data[i] >> 4) & 0xf], hex[data[i] & 0xf] };
+            out.append(buf, sizeof buf);
         } else {
-            out += ch;
+            out.append(data + run, i - run);
+            const char buf[2] = { '\\', static_cast<char>(cls) };
+            out.append(buf, sizeof buf);
         }
+        run = i + 1;
     }
+    out.append(data + run, len - run);
     out += '"';
 }
 
@@ -141,6 +198,55 @@ void Json::dump(string &out) const {
     m_ptr->dump(out);
 }
 
+void Json::cache_dump() const {
+    m_ptr->cache_dump();
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Hashing
+ */
+
+static size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+static size_t hash_value(NullStruct) {
+    return 0x6e756c6c;
+}
+
+static size_t hash_value(double value) {
+    // Ints and doubles compare by value, so both hash as doubles; 0.0 == -0.0.
+    return std::hash<double>()(value == 0 ? 0.0 : value);
+}
+
+static size_t hash_value(int value) {
+    return hash_value(static_cast<double>(value));
+}
+
+static size_t hash_value(bool value) {
+    return value ? 0x74727565 : 0x66616c73;
+}
+
+static size_t hash_value(const string &value) {
+    return std::hash<string>()(value);
+}
+
+static size_t hash_value(const Json::array &values) {
+    size_t hash = hash_combine(0x5b5d, values.size());
+    for (const auto &value : values)
+        hash = hash_combine(hash, value.hash());
+    return hash;
+}
+
+// Members are combined independently of their order, which OrderedObject's operator==
+// ignores.
+static size_t hash_value(const Json::object &values) {
+    size_t hash = 0;
+    for (const auto &kv : values)
+        hash += hash_combine(hash_value(kv.first), kv.second.hash());
+    return hash_combine(0x7b7d, hash);
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Value wrappers
  */
@@ -168,6 +274,68 @@ protected:
 
     const T m_value;
     void dump(string &out) const override { json11::dump(m_value, out); }
+    size_t hash() const override { return json11::hash_value(m_value); }
+};
+
+/* CachedHash
+ *
+ * A container's hash, computed on first use. Nodes are immutable, so it never goes stale;
+ * concurrent first uses just compute the same value twice. 0 means not computed yet.
+ */
+class CachedHash {
+public:
+    CachedHash() : m_hash(0) {}
+
+    size_t get() const { return m_hash.load(std::memory_order_relaxed); }
+
+    template <typename T>
+    size_t get_or_compute(const T &value) const {
+        size_t hash = get();
+        if (hash == 0) {
+            hash = hash_value(value);
+            if (hash == 0)
+                hash = 1;
+            m_hash.store(hash, std::memory_order_relaxed);
+        }
+        return hash;
+    }
+
+private:
+    mutable std::atomic<size_t> m_hash;
+};
+
+/* CachedDump
+ *
+ * A container's serialized bytes, kept once cache_dump() asks for them. Nodes are
+ * immutable, so they never go stale; if two threads fill it at once, one copy is dropped.
+ */
+class CachedDump {
+public:
+    CachedDump() : m_dump(nullptr) {}
+    ~CachedDump() { delete m_dump.load(std::memory_order_relaxed); }
+
+    // Append the cached bytes to out and return true, or return false if there are none.
+    bool append(string &out) const {
+        const string *dump = m_dump.load(std::memory_order_acquire);
+        if (!dump)
+            return false;
+        out += *dump;
+        return true;
+    }
+
+    template <typename T>
+    void fill(const T &value) const {
+        if (m_dump.load(std::memory_order_acquire))
+            return;
+        string *dump = new string;
+        json11::dump(value, *dump);
+        const string *expected = nullptr;
+        if (!m_dump.compare_exchange_strong(expected, dump, std::memory_order_acq_rel))
+            delete dump;
+    }
+
+private:
+    mutable std::atomic<const string *> m_dump;
 };
 
 class JsonDouble final : public Value<Json::NUMBER, double> {
@@ -204,17 +372,37 @@ public:
 class JsonArray final : public Value<Json::ARRAY, Json::array> {
     const Json::array &array_items() const override { return m_value; }
     const Json & operator[](size_t i) const override;
+    size_t hash() const override { return m_hash.get_or_compute(m_value); }
+    size_t cached_hash() const override { return m_hash.get(); }
+    void dump(string &out) const override {
+        if (!m_dump.append(out))
+            json11::dump(m_value, out);
+    }
+    void cache_dump() const override { m_dump.fill(m_value); }
+    CachedHash m_hash;
+    CachedDump m_dump;
 public:
     explicit JsonArray(const Json::array &value) : Value(value) {}
     explicit JsonArray(Json::array &&value)      : Value(move(value)) {}
+    ~JsonArray() override;
 };
 
 class JsonObject final : public Value<Json::OBJECT, Json::object> {
     const Json::object &object_items() const override { return m_value; }
     const Json & operator[](const string &key) const override;
+    size_t hash() const override { return m_hash.get_or_compute(m_value); }
+    size_t cached_hash() const override { return m_hash.get(); }
+    void dump(string &out) const override {
+        if (!m_dump.append(out))
+            json11::dump(m_value, out);
+    }
+    void cache_dump() const override { m_dump.fill(m_value); }
+    CachedHash m_hash;
+    CachedDump m_dump;
 public:
     explicit JsonObject(const Json::object &value) : Value(value) {}
     explicit JsonObject(Json::object &&value)      : Value(move(value)) {}
+    ~JsonObject() override;
 };
 
 class JsonNull final : public Value<Json::NUL, NullStruct> {
@@ -225,19 +413,41 @@ public:
 /* * * * * * * * * * * * * * * * * * * *
  * Static globals - static-init-safe
  */
+
+// Integers in this range share preallocated nodes instead of allocating one per value.
+static const int small_int_min = -16;
+static const int small_int_max = 255;
+
+/* immortal(value)
+ *
+ * Wrap a node that is never freed in a shared_ptr with no control block. Copying and
+ * destroying such a pointer does not touch a reference count, so the shared singletons
+ * below are not a cache line that every thread creating a null or a bool writes to.
+ */
+static std::shared_ptr<JsonValue> immortal(JsonValue *value) {
+    return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), value);
+}
+
 struct Statics {
-    const std::shared_ptr<JsonValue> null = make_shared<JsonNull>();
-    const std::shared_ptr<JsonValue> t = make_shared<JsonBoolean>(true);
-    const std::shared_ptr<JsonValue> f = make_shared<JsonBoolean>(false);
+    const std::shared_ptr<JsonValue> null = immortal(new JsonNull);
+    const std::shared_ptr<JsonValue> t = immortal(new JsonBoolean(true));
+    const std::shared_ptr<JsonValue> f = immortal(new JsonBoolean(false));
+    const std::shared_ptr<JsonValue> empty_string_value = immortal(new JsonString(string()));
+    std::shared_ptr<JsonValue> small_ints[small_int_max - small_int_min + 1];
     const string empty_string;
     const vector<Json> empty_vector;
-    const map<string, Json> empty_map;
-    Statics() {}
+    const Json::object empty_map;
+    Statics() {
+        for (int i = small_int_min; i <= small_int_max; i++)
+            small_ints[i - small_int_min] = immortal(new JsonInt(i));
+    }
 };
 
+// Never destroyed, so the singletons stay valid for Json values that outlive static
+// destruction.
 static const Statics & statics() {
-    static const Statics s {};
-    return s;
+    static const Statics *s = new Statics;
+    return *s;
 }
 
 static const Json & static_null() {
@@ -250,14 +460,34 @@ static const Json & static_null() {
  * Constructors
  */
 
+static std::shared_ptr<JsonValue> make_number(int value) {
+    if (value >= small_int_min && value <= small_int_max)
+        return statics().small_ints[value - small_int_min];
+    return make_shared<JsonInt>(value);
+}
+
+// A double holding a small integer behaves exactly like the int (same comparisons, same
+// dump() output), so it can share the int's node. -0.0 is excluded since it dumps as "-0".
+static std::shared_ptr<JsonValue> make_number(double value) {
+    if (value >= small_int_min && value <= small_int_max) {
+        const int i = static_cast<int>(value);
+        if (i == value && (i != 0 || !std::signbit(value)))
+            return statics().small_ints[i - small_int_min];
+    }
+    return make_shared<JsonDouble>(value);
+}
+
 Json::Json() noexcept                  : m_ptr(statics().null) {}
 Json::Json(std::nullptr_t) noexcept    : m_ptr(statics().null) {}
-Json::Json(double value)               : m_ptr(make_shared<JsonDouble>(value)) {}
-Json::Json(int value)                  : m_ptr(make_shared<JsonInt>(value)) {}
+Json::Json(double value)               : m_ptr(make_number(value)) {}
+Json::Json(int value)                  : m_ptr(make_number(value)) {}
 Json::Json(bool value)                 : m_ptr(value ? statics().t : statics().f) {}
-Json::Json(const string &value)        : m_ptr(make_shared<JsonString>(value)) {}
-Json::Json(string &&value)             : m_ptr(make_shared<JsonString>(move(value))) {}
-Json::Json(const char * value)         : m_ptr(make_shared<JsonString>(value)) {}
+Json::Json(const string &value)        : m_ptr(value.empty() ? statics().empty_string_value
+                                                             : make_shared<JsonString>(value)) {}
+Json::Json(string &&value)             : m_ptr(value.empty() ? statics().empty_string_value
+                                                             : make_shared<JsonString>(move(value))) {}
+Json::Json(const char * value)         : m_ptr(*value == '\0' ? statics().empty_string_value
+                                                              : make_shared<JsonString>(value)) {}
 Json::Json(const Json::array &values)  : m_ptr(make_shared<JsonArray>(values)) {}
 Json::Json(Json::array &&values)       : m_ptr(make_shared<JsonArray>(move(values))) {}
 Json::Json(const Json::object &values) : m_ptr(make_shared<JsonObject>(values)) {}
@@ -273,16 +503,18 @@ int Json::int_value()                             const { return m_ptr->int_valu
 bool Json::bool_value()                           const { return m_ptr->bool_value();   }
 const string & Json::string_value()               const { return m_ptr->string_value(); }
 const vector<Json> & Json::array_items()          const { return m_ptr->array_items();  }
-const map<string, Json> & Json::object_items()    const { return m_ptr->object_items(); }
+const Json::object & Json::object_items()         const { return m_ptr->object_items(); }
 const Json & Json::operator[] (size_t i)          const { return (*m_ptr)[i];           }
 const Json & Json::operator[] (const string &key) const { return (*m_ptr)[key];         }
 
+size_t                    JsonValue::cached_hash()               const { return 0; }
+void                      JsonValue::cache_dump()                const {}
 double                    JsonValue::number_value()              const { return 0; }
 int                       JsonValue::int_value()                 const { return 0; }
 bool                      JsonValue::bool_value()                const { return false; }
 const string &            JsonValue::string_value()              const { return statics().empty_string; }
 const vector<Json> &      JsonValue::array_items()               const { return statics().empty_vector; }
-const map<string, Json> & JsonValue::object_items()              const { return statics().empty_map; }
+const Json::object &      JsonValue::object_items()              const { return statics().empty_map; }
 const Json &              JsonValue::operator[] (size_t)         const { return static_null(); }
 const Json &              JsonValue::operator[] (const string &) const { return static_null(); }
 
@@ -295,16 +527,78 @@ const Json & JsonArray::operator[] (size_t i) const {
     else return m_value[i];
 }
 
+/* * * * * * * * * * * * * * * * * * * *
+ * Destruction
+ *
+ * Releasing a deeply nested document would otherwise recurse once per level through the
+ * shared_ptr destructors. Instead, the outermost container destroyed on a thread drains a
+ * worklist, and any container destroyed while it runs hands its container children to that
+ * worklist rather than releasing them in place.
+ */
+
+static thread_local vector<Json> *release_list = nullptr;
+
+static void defer_release(Json &child, vector<Json> &list) {
+    if (child.is_array() || child.is_object())
+        list.push_back(move(child));
+}
+
+static void drain_release(vector<Json> &pending) {
+    if (pending.empty())
+        return;
+
+    release_list = &pending;
+    while (!pending.empty()) {
+        Json json = move(pending.back());
+        pending.pop_back();
+    }
+    release_list = nullptr;
+}
+
+// const does not apply to members of an object under destruction, so the children can be
+// moved out of m_value here.
+JsonArray::~JsonArray() {
+    vector<Json> pending;
+    vector<Json> &list = release_list ? *release_list : pending;
+    for (Json &item : const_cast<Json::array &>(m_value))
+        defer_release(item, list);
+    drain_release(pending);
+}
+
+JsonObject::~JsonObject() {
+    vector<Json> pending;
+    vector<Json> &list = release_list ? *release_list : pending;
+    for (auto &kv : const_cast<Json::object &>(m_value))
+        defer_release(kv.second, list);
+    drain_release(pending);
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Comparison
  */
 
+size_t Json::hash() const {
+    return m_ptr->hash();
+}
+
 bool Json::operator== (const Json &other) const {
     if (m_ptr == other.m_ptr)
         return true;
-    if (m_ptr->type() != other.m_ptr->type())
+    const Json::Type type = m_ptr->type();
+    if (type != other.m_ptr->type())
         return false;
 
+    // Containers with different cached hashes differ; others need the full comparison (which
+    // repeats the shared-node check above for every element).
+    if (type == ARRAY || type == OBJECT) {
+        const size_t hash = m_ptr->cached_hash();
+        if (hash != 0) {
+            const size_t other_hash = other.m_ptr->cached_hash();
+            if (other_hash != 0 && other_hash != hash)
+                return false;
+        }
+    }
+
     return m_ptr->equals(other.m_ptr.get());
 }
 
@@ -317,6 +611,163 @@ bool Json::operator< (const Json &other) const {
     return m_ptr->less(other.m_ptr.get());
 }
 
+#ifdef JSON11_ORDERED_OBJECT
+/* * * * * * * * * * * * * * * * * * * *
+ * OrderedObject
+ */
+
+// Objects up to this size are searched linearly and carry no hash index.
+static const size_t ordered_linear_max = 8;
+
+size_t OrderedObject::hash_key(const char *key, size_t len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(key[i]);
+        hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+/* lookup(key, len)
+ *
+ * Return the position of the member named key, or size() if there is none.
+ */
+size_t OrderedObject::lookup(const char *key, size_t len) const {
+    if (m_slots.empty()) {
+        for (size_t i = 0; i < m_items.size(); i++) {
+            const string &k = m_items[i].first;
+            if (k.size() == len && k.compare(0, len, key, len) == 0)
+                return i;
+        }
+        return m_items.size();
+    }
+    return lookup(key, len, hash_key(key, len));
+}
+
+size_t OrderedObject::lookup(const char *key, size_t len, size_t hash) const {
+    if (m_slots.empty())
+        return lookup(key, len);
+
+    const size_t mask = m_slots.size() - 1;
+    for (size_t s = hash & mask; ; s = (s + 1) & mask) {
+        const Slot &slot = m_slots[s];
+        if (slot.entry == 0)
+            return m_items.size();
+        if (slot.hash == static_cast<uint32_t>(hash)) {
+            const string &k = m_items[slot.entry - 1].first;
+            if (k.size() == len && k.compare(0, len, key, len) == 0)
+                return slot.entry - 1;
+        }
+    }
+}
+
+void OrderedObject::place(size_t entry, size_t hash) {
+    const size_t mask = m_slots.size() - 1;
+    size_t s = hash & mask;
+    while (m_slots[s].entry != 0)
+        s = (s + 1) & mask;
+    m_slots[s] = Slot { static_cast<uint32_t>(entry + 1), static_cast<uint32_t>(hash) };
+}
+
+void OrderedObject::rebuild_index() {
+    if (m_items.size() <= ordered_linear_max) {
+        m_slots.clear();
+        return;
+    }
+
+    // Keep the load factor at or below one half.
+    size_t capacity = 16;
+    while (capacity < 2 * m_items.size())
+        capacity *= 2;
+    m_slots.assign(capacity, Slot { 0, 0 });
+    for (size_t i = 0; i < m_items.size(); i++)
+        place(i, hash_key(m_items[i].first.data(), m_items[i].first.size()));
+}
+
+/* index_back(hash)
+ *
+ * Add the member just appended to m_items to the index.
+ */
+void OrderedObject::index_back(size_t hash) {
+    if (m_slots.empty() || 2 * m_items.size() > m_slots.size())
+        rebuild_index();
+    else
+        place(m_items.size() - 1, hash);
+}
+
+std::pair<OrderedObject::iterator, bool> OrderedObject::insert(value_type &&kv) {
+    const size_t i = lookup(kv.first.data(), kv.first.size());
+    if (i != m_items.size())
+        return { m_items.begin() + static_cast<std::ptrdiff_t>(i), false };
+
+    const size_t hash = m_slots.empty() ? 0 : hash_key(kv.first.data(), kv.first.size());
+    m_items.push_back(move(kv));
+    index_back(hash);
+    return { m_items.end() - 1, true };
+}
+
+Json & OrderedObject::operator[](string &&key) {
+    const size_t i = lookup(key.data(), key.size());
+    if (i != m_items.size())
+        return m_items[i].second;
+
+    const size_t hash = m_slots.empty() ? 0 : hash_key(key.data(), key.size());
+    m_items.emplace_back(move(key), Json());
+    index_back(hash);
+    return m_items.back().second;
+}
+
+#if JSON11_HAS_STRING_VIEW
+const Json & OrderedObject::at(std::string_view key) const {
+#else
+const Json & OrderedObject::at(const string &key) const {
+#endif
+    const size_t i = lookup(key.data(), key.size());
+    if (i == m_items.size())
+        throw std::out_of_range("OrderedObject::at");
+    return m_items[i].second;
+}
+
+OrderedObject::size_type OrderedObject::erase(const string &key) {
+    const size_t i = lookup(key.data(), key.size());
+    if (i == m_items.size())
+        return 0;
+
+    m_items.erase(m_items.begin() + static_cast<std::ptrdiff_t>(i));
+    rebuild_index();
+    return 1;
+}
+
+bool OrderedObject::operator==(const OrderedObject &other) const {
+    if (m_items.size() != other.m_items.size())
+        return false;
+    for (const auto &kv : m_items) {
+        const size_t i = other.lookup(kv.first.data(), kv.first.size());
+        if (i == other.m_items.size() || !(kv.second == other.m_items[i].second))
+            return false;
+    }
+    return true;
+}
+
+// Ordered like std::map, by members sorted by key, so that it agrees with operator==.
+bool OrderedObject::operator<(const OrderedObject &other) const {
+    auto sorted = [](const OrderedObject &obj) {
+        vector<const value_type *> items;
+        items.reserve(obj.m_items.size());
+        for (const auto &kv : obj.m_items)
+            items.push_back(&kv);
+        std::sort(items.begin(), items.end(), [](const value_type *a, const value_type *b) {
+            return a->first < b->first;
+        });
+        return items;
+    };
+    const vector<const value_type *> lhs = sorted(*this), rhs = sorted(other);
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+        [](const value_type *a, const value_type *b) { return *a < *b; });
+}
+#endif
+
 /* * * * * * * * * * * * * * * * * * * *
  * Parsing
  */
@@ -339,6 +790,43 @@ static inline bool in_range(long x, long lower, long upper) {
     return (x >= lower && x <= upper);
 }
 
+string JsonError::message(const string &in) const {
+    const size_t pos = std::min(offset, in.size());
+    const char ch = in[pos];
+    switch (code) {
+    case NONE:                          return "";
+    case UNEXPECTED_END:                return "unexpected end of input";
+    case UNEXPECTED_END_IN_STRING:      return "unexpected end of input in string";
+    case UNEXPECTED_END_IN_COMMENT:     return "unexpected end of input inside multi-line comment";
+    case UNEXPECTED_END_AFTER_SLASH:    return "unexpected end of input after start of comment";
+    case MALFORMED_COMMENT:             return "malformed comment";
+    case UNESCAPED_CONTROL_CHARACTER:   return "unescaped " + esc(ch) + " in string";
+    case BAD_UNICODE_ESCAPE:            return "bad \\u escape: " + in.substr(pos, 4);
+    case INVALID_ESCAPE:                return "invalid escape character " + esc(ch);
+    case LEADING_ZERO:                  return "leading 0s not permitted in numbers";
+    case INVALID_NUMBER:                return "invalid " + esc(ch) + " in number";
+    case MISSING_FRACTION_DIGITS:       return "at least one digit required in fractional part";
+    case MISSING_EXPONENT_DIGITS:       return "at least one digit required in exponent";
+    case INVALID_LITERAL: {
+        const string expected = ch == 't' ? "true" : ch == 'f' ? "false" : "null";
+        return "parse error: expected " + expected + ", got " + in.substr(pos, expected.size());
+    }
+    case EXPECTED_VALUE:                return "expected value, got " + esc(ch);
+    case EXPECTED_KEY:                  return "expected '\"' in object, got " + esc(ch);
+    case EXPECTED_COLON:                return "expected ':' in object, got " + esc(ch);
+    case EXPECTED_OBJECT_SEPARATOR:     return "expected ',' in object, got " + esc(ch);
+    case EXPECTED_ARRAY_SEPARATOR:      return "expected ',' in list, got " + esc(ch);
+    case EXCEEDED_MAX_DEPTH:            return "exceeded maximum nesting depth";
+    case TRAILING_CHARACTERS:           return "unexpected trailing " + esc(ch);
+    case EXPECTED_NUMBER:               return "expected number, got " + esc(ch);
+    case EXPECTED_BOOL:                 return "expected bool, got " + esc(ch);
+    case EXPECTED_STRING:               return "expected string, got " + esc(ch);
+    case EXPECTED_ARRAY:                return "expected array, got " + esc(ch);
+    case EXPECTED_OBJECT:               return "expected object, got " + esc(ch);
+    }
+    return "parse error";
+}
+
 namespace {
 /* JsonParser
  *
@@ -350,88 +838,119 @@ struct JsonParser final {
      */
     const string &str;
     size_t i;
-    string &err;
+    string *err;        // formatted message, if the caller wants one
+    JsonError error;
     bool failed;
     const JsonParse strategy;
+    const int max_depth;
+    vector<Json> string_cache;
 
-    /* fail(msg, err_ret = Json())
+    /* fail(code, offset, err_ret = Json())
      *
-     * Mark this parse as failed.
+     * Mark this parse as failed, recording the first error. Its message is only formatted
+     * if the caller asked for one.
      */
-    Json fail(string &&msg) {
-        return fail(move(msg), Json());
+    Json fail(JsonError::Code code, size_t offset) {
+        return fail(code, offset, Json());
     }
 
     template <typename T>
-    T fail(string &&msg, const T err_ret) {
-        if (!failed)
-            err = std::move(msg);
+    T fail(JsonError::Code code, size_t offset, const T err_ret) {
+        if (!failed) {
+            error.code = code;
+            error.offset = offset;
+            if (err)
+                *err = error.message(str);
+        }
         failed = true;
         return err_ret;
     }
 
     /* consume_whitespace()
      *
-     * Advance until the current character is non-whitespace.
+     * Advance until the current character is non-whitespace. Compact input has at most a
+     * byte or two of whitespace between tokens, so that case is checked a byte at a time;
+     * longer runs such as indentation are skipped in 16-byte blocks where SSE2 is available.
      */
     void consume_whitespace() {
-        while (str[i] == ' ' || str[i] == '\r' || str[i] == '\n' || str[i] == '\t')
+        for (int n = 0; n < 4; n++, i++) {
+            if (!is_space(str[i]))
+                return;
+        }
+#if JSON11_HAS_SSE2
+        const char *data = str.data();
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t');
+        while (i + 16 <= str.size()) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            const __m128i ws = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, cr)),
+                _mm_or_si128(_mm_cmpeq_epi8(block, lf), _mm_cmpeq_epi8(block, tab)));
+            if (_mm_movemask_epi8(ws) != 0xFFFF)
+                break;
+            i += 16;
+        }
+#endif
+        while (is_space(str[i]))
             i++;
     }
 
+    static bool is_space(char ch) {
+        return ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t';
+    }
+
     /* consume_comment()
      *
-     * Advance comments (c-style inline and multiline).
+     * Advance past a comment (c-style inline and multiline) starting at the current
+     * character, which must be '/'. Comment bodies are searched with memchr.
      */
-    bool consume_comment() {
-      bool comment_found = false;
-      if (str[i] == '/') {
+    void consume_comment() {
+        const char *data = str.data();
+        const size_t size = str.size();
         i++;
-        if (i == str.size())
-          return fail("unexpected end of input after start of comment", false);
+        if (i == size) {
+            fail(JsonError::UNEXPECTED_END_AFTER_SLASH, i);
+            return;
+        }
         if (str[i] == '/') { // inline comment
-          i++;
-          // advance until next line, or end of input
-          while (i < str.size() && str[i] != '\n') {
-            i++;
-          }
-          comment_found = true;
+            // advance until next line, or end of input
+            const void *nl = memchr(data + i, '\n', size - i);
+            i = nl ? static_cast<size_t>(static_cast<const char *>(nl) - data) : size;
         }
         else if (str[i] == '*') { // multiline comment
-          i++;
-          if (i > str.size()-2)
-            return fail("unexpected end of input inside multi-line comment", false);
-          // advance until closing tokens
-          while (!(str[i] == '*' && str[i+1] == '/')) {
             i++;
-            if (i > str.size()-2)
-              return fail(
-                "unexpected end of input inside multi-line comment", false);
-          }
-          i += 2;
-          comment_found = true;
+            // advance until closing tokens
+            for (;;) {
+                const void *star = memchr(data + i, '*', size - i);
+                if (!star || static_cast<const char *>(star) + 1 >= data + size) {
+                    fail(JsonError::UNEXPECTED_END_IN_COMMENT, size);
+                    return;
+                }
+                i = static_cast<size_t>(static_cast<const char *>(star) - data) + 1;
+                if (str[i] == '/')
+                    break;
+            }
+            i++;
         }
         else
-          return fail("malformed comment", false);
-      }
-      return comment_found;
+            fail(JsonError::MALFORMED_COMMENT, i);
     }
 
     /* consume_garbage()
      *
-     * Advance until the current character is non-whitespace and non-comment.
+     * Advance until the current character is non-whitespace and non-comment. The strategy
+     * is only consulted when whitespace ends at a '/', which is never the case in valid
+     * STANDARD input, so the comment logic costs STANDARD parses a single compare.
      */
     void consume_garbage() {
-      consume_whitespace();
-      if(strategy == JsonParse::COMMENTS) {
-        bool comment_found = false;
-        do {
-          comment_found = consume_comment();
-          if (failed) return;
-          consume_whitespace();
+        consume_whitespace();
+        while (str[i] == '/' && strategy == JsonParse::COMMENTS) {
+            consume_comment();
+            if (failed) return;
+            consume_whitespace();
         }
-        while(comment_found);
-      }
     }
 
     /* get_next_token()
@@ -443,7 +962,7 @@ struct JsonParser final {
         consume_garbage();
         if (failed) return static_cast<char>(0);
         if (i == str.size())
-            return fail("unexpected end of input", static_cast<char>(0));
+            return fail(JsonError::UNEXPECTED_END, i, static_cast<char>(0));
 
         return str[i++];
     }
@@ -482,7 +1001,7 @@ struct JsonParser final {
         long last_escaped_codepoint = -1;
         while (true) {
             if (i == str.size())
-                return fail("unexpected end of input in string", "");
+                return fail(JsonError::UNEXPECTED_END_IN_STRING, i, "");
 
             char ch = str[i++];
 
@@ -492,7 +1011,7 @@ struct JsonParser final {
             }
 
             if (in_range(ch, 0, 0x1f))
-                return fail("unescaped " + esc(ch) + " in string", "");
+                return fail(JsonError::UNESCAPED_CONTROL_CHARACTER, i - 1, "");
 
             // The usual case: non-escaped characters
             if (ch != '\\') {
@@ -504,7 +1023,7 @@ struct JsonParser final {
 
             // Handle escapes
             if (i == str.size())
-                return fail("unexpected end of input in string", "");
+                return fail(JsonError::UNEXPECTED_END_IN_STRING, i, "");
 
             ch = str[i++];
 
@@ -515,12 +1034,12 @@ struct JsonParser final {
                 // relies on std::string returning the terminating NUL when
                 // accessing str[length]. Checking here reduces brittleness.
                 if (esc.length() < 4) {
-                    return fail("bad \\u escape: " + esc, "");
+                    return fail(JsonError::BAD_UNICODE_ESCAPE, i, "");
                 }
                 for (size_t j = 0; j < 4; j++) {
                     if (!in_range(esc[j], 'a', 'f') && !in_range(esc[j], 'A', 'F')
                             && !in_range(esc[j], '0', '9'))
-                        return fail("bad \\u escape: " + esc, "");
+                        return fail(JsonError::BAD_UNICODE_ESCAPE, i, "");
                 }
 
                 long codepoint = strtol(esc.data(), nullptr, 16);
@@ -561,18 +1080,46 @@ struct JsonParser final {
             } else if (ch == '"' || ch == '\\' || ch == '/') {
                 out += ch;
             } else {
-                return fail("invalid escape character " + esc(ch), "");
+                return fail(JsonError::INVALID_ESCAPE, i - 1, "");
             }
         }
     }
 
-    /* parse_number()
+    /* intern(value)
      *
-     * Parse a double.
+     * Return a Json for the string value just parsed. Documents tend to repeat short values
+     * such as enums and status words, so short strings are looked up in a small
+     * direct-mapped cache first, and a repeat shares the earlier (immutable) node instead
+     * of allocating its own. Longer strings are not worth hashing.
      */
-    Json parse_number() {
-        size_t start_pos = i;
+    Json intern(string &&value) {
+        static const size_t max_interned_length = 15;
+        static const size_t string_cache_size = 64;
 
+        if (value.empty() || value.size() > max_interned_length)
+            return Json(move(value));
+
+        if (string_cache.empty())
+            string_cache.resize(string_cache_size);
+
+        size_t hash = value.size();
+        for (char ch : value)
+            hash = hash * 31 + static_cast<uint8_t>(ch);
+
+        Json &slot = string_cache[hash & (string_cache_size - 1)];
+        if (slot.is_string() && slot.string_value() == value)
+            return slot;
+
+        slot = Json(move(value));
+        return slot;
+    }
+
+    /* scan_number(integral)
+     *
+     * Advance past a number, checking its syntax. Set integral if it has neither a
+     * fractional part nor an exponent. Return false and flag an error if it is malformed.
+     */
+    bool scan_number(bool &integral) {
         if (str[i] == '-')
             i++;
 
@@ -580,25 +1127,22 @@ struct JsonParser final {
         if (str[i] == '0') {
             i++;
             if (in_range(str[i], '0', '9'))
-                return fail("leading 0s not permitted in numbers");
+                return fail(JsonError::LEADING_ZERO, i, false);
         } else if (in_range(str[i], '1', '9')) {
             i++;
             while (in_range(str[i], '0', '9'))
                 i++;
         } else {
-            return fail("invalid " + esc(str[i]) + " in number");
+            return fail(JsonError::INVALID_NUMBER, i, false);
         }
 
-        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
-                && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
-            return std::atoi(str.c_str() + start_pos);
-        }
+        integral = str[i] != '.' && str[i] != 'e' && str[i] != 'E';
 
         // Decimal part
         if (str[i] == '.') {
             i++;
             if (!in_range(str[i], '0', '9'))
-                return fail("at least one digit required in fractional part");
+                return fail(JsonError::MISSING_FRACTION_DIGITS, i, false);
 
             while (in_range(str[i], '0', '9'))
                 i++;
@@ -612,15 +1156,76 @@ struct JsonParser final {
                 i++;
 
             if (!in_range(str[i], '0', '9'))
-                return fail("at least one digit required in exponent");
+                return fail(JsonError::MISSING_EXPONENT_DIGITS, i, false);
 
             while (in_range(str[i], '0', '9'))
                 i++;
         }
 
+        return true;
+    }
+
+    /* parse_number()
+     *
+     * Parse a double.
+     */
+    Json parse_number() {
+        size_t start_pos = i;
+
+        bool integral;
+        if (!scan_number(integral))
+            return Json();
+
+        if (integral && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10))
+            return std::atoi(str.c_str() + start_pos);
+
         return std::strtod(str.c_str() + start_pos, nullptr);
     }
 
+    /* skip_string(escaped)
+     *
+     * Advance past a string, starting after its opening quote, checking it as parse_string()
+     * does but without decoding it. Set escaped if it contains any escape sequence. Return
+     * false and flag an error if it is malformed.
+     */
+    bool skip_string(bool &escaped) {
+        escaped = false;
+        while (true) {
+            if (i == str.size())
+                return fail(JsonError::UNEXPECTED_END_IN_STRING, i, false);
+
+            char ch = str[i++];
+            if (ch == '"')
+                return true;
+
+            if (in_range(ch, 0, 0x1f))
+                return fail(JsonError::UNESCAPED_CONTROL_CHARACTER, i - 1, false);
+
+            if (ch != '\\')
+                continue;
+
+            escaped = true;
+            if (i == str.size())
+                return fail(JsonError::UNEXPECTED_END_IN_STRING, i, false);
+
+            ch = str[i++];
+            if (ch == 'u') {
+                string esc = str.substr(i, 4);
+                if (esc.length() < 4)
+                    return fail(JsonError::BAD_UNICODE_ESCAPE, i, false);
+                for (size_t j = 0; j < 4; j++) {
+                    if (!in_range(esc[j], 'a', 'f') && !in_range(esc[j], 'A', 'F')
+                            && !in_range(esc[j], '0', '9'))
+                        return fail(JsonError::BAD_UNICODE_ESCAPE, i, false);
+                }
+                i += 4;
+            } else if (ch != 'b' && ch != 'f' && ch != 'n' && ch != 'r' && ch != 't'
+                       && ch != '"' && ch != '\\' && ch != '/') {
+                return fail(JsonError::INVALID_ESCAPE, i - 1, false);
+            }
+        }
+    }
+
     /* expect(str, res)
      *
      * Expect that 'str' starts at the character that was just read. If it does, advance
@@ -633,23 +1238,49 @@ struct JsonParser final {
             i += expected.length();
             return res;
         } else {
-            return fail("parse error: expected " + expected + ", got " + str.substr(i, expected.length()));
+            return fail(JsonError::INVALID_LITERAL, i);
         }
     }
 
-    /* parse_json()
+    /* Frame
      *
-     * Parse a JSON object.
+     * An array or object that has been opened but not yet closed. parse_json() keeps these
+     * on an explicit stack instead of recursing, so the nesting it can handle is bounded by
+     * max_depth and the heap rather than by the call stack.
      */
-    Json parse_json(int depth) {
-        if (depth > max_depth) {
-            return fail("exceeded maximum nesting depth");
-        }
+    struct Frame {
+        explicit Frame(bool is_object) : is_object(is_object) {}
+        bool is_object;
+        Json::array array;
+        Json::object object;
+        string key;
+    };
+
+    /* parse_key(ch, key)
+     *
+     * Parse an object key starting at token ch, followed by its ':'. Return false and flag
+     * an error if either is missing.
+     */
+    bool parse_key(char ch, string &key) {
+        if (ch != '"')
+            return fail(JsonError::EXPECTED_KEY, i - 1, false);
 
-        char ch = get_next_token();
+        key = parse_string();
         if (failed)
-            return Json();
+            return false;
+
+        ch = get_next_token();
+        if (ch != ':')
+            return fail(JsonError::EXPECTED_COLON, i - 1, false);
 
+        return true;
+    }
+
+    /* parse_scalar(ch)
+     *
+     * Parse a number, string or literal whose first character ch was just read.
+     */
+    Json parse_scalar(char ch) {
         if (ch == '-' || (ch >= '0' && ch <= '9')) {
             i--;
             return parse_number();
@@ -665,81 +1296,113 @@ struct JsonParser final {
             return expect("null", Json());
 
         if (ch == '"')
-            return parse_string();
+            return intern(parse_string());
+
+        return fail(JsonError::EXPECTED_VALUE, i - 1);
+    }
+
+    /* parse_json(depth)
+     *
+     * Parse a JSON value that starts at nesting level depth. Open containers are kept on an
+     * explicit stack of Frames, so this never recurses.
+     */
+    Json parse_json(int depth) {
+        vector<Frame> stack;
+        Json value;
+
+        while (true) {
+            if (depth + static_cast<long>(stack.size()) > max_depth)
+                return fail(JsonError::EXCEEDED_MAX_DEPTH, i);
 
-        if (ch == '{') {
-            map<string, Json> data;
-            ch = get_next_token();
-            if (ch == '}')
-                return data;
+            char ch = get_next_token();
+            if (failed)
+                return Json();
 
-            while (1) {
-                if (ch != '"')
-                    return fail("expected '\"' in object, got " + esc(ch));
+            if (ch == '{' || ch == '[') {
+                stack.emplace_back(ch == '{');
+                Frame &frame = stack.back();
 
-                string key = parse_string();
+                ch = get_next_token();
                 if (failed)
                     return Json();
 
-                ch = get_next_token();
-                if (ch != ':')
-                    return fail("expected ':' in object, got " + esc(ch));
+                if (ch != (frame.is_object ? '}' : ']')) {
+                    if (frame.is_object) {
+                        if (!parse_key(ch, frame.key))
+                            return Json();
+                    } else {
+                        i--;
+                    }
+                    continue;
+                }
 
-                data[std::move(key)] = parse_json(depth + 1);
+                value = frame.is_object ? Json(move(frame.object)) : Json(move(frame.array));
+                stack.pop_back();
+            } else {
+                value = parse_scalar(ch);
                 if (failed)
                     return Json();
+            }
 
-                ch = get_next_token();
-                if (ch == '}')
-                    break;
-                if (ch != ',')
-                    return fail("expected ',' in object, got " + esc(ch));
+            // A value is complete: store it in its container, closing every container that
+            // ends right after it, until one expects another member.
+            while (!stack.empty()) {
+                Frame &frame = stack.back();
+                if (frame.is_object)
+                    frame.object[move(frame.key)] = move(value);
+                else
+                    frame.array.push_back(move(value));
 
                 ch = get_next_token();
-            }
-            return data;
-        }
+                if (ch == (frame.is_object ? '}' : ']')) {
+                    value = frame.is_object ? Json(move(frame.object)) : Json(move(frame.array));
+                    stack.pop_back();
+                    continue;
+                }
 
-        if (ch == '[') {
-            vector<Json> data;
-            ch = get_next_token();
-            if (ch == ']')
-                return data;
+                if (ch != ',') {
+                    return fail(frame.is_object ? JsonError::EXPECTED_OBJECT_SEPARATOR
+                                                : JsonError::EXPECTED_ARRAY_SEPARATOR, i - 1);
+                }
 
-            while (1) {
-                i--;
-                data.push_back(parse_json(depth + 1));
-                if (failed)
+                if (frame.is_object && !parse_key(get_next_token(), frame.key))
                     return Json();
-
-                ch = get_next_token();
-                if (ch == ']')
-                    break;
-                if (ch != ',')
-                    return fail("expected ',' in list, got " + esc(ch));
-
-                ch = get_next_token();
-                (void)ch;
+                break;
             }
-            return data;
-        }
 
-        return fail("expected value, got " + esc(ch));
+            if (stack.empty())
+                return value;
+        }
     }
 };
 }//namespace {
 
-Json Json::parse(const string &in, string &err, JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+/* parse_document(parser)
+ *
+ * Parse a single value that must make up the whole input.
+ */
+static Json parse_document(JsonParser &parser) {
     Json result = parser.parse_json(0);
 
     // Check for any trailing garbage
     parser.consume_garbage();
     if (parser.failed)
         return Json();
-    if (parser.i != in.size())
-        return parser.fail("unexpected trailing " + esc(in[parser.i]));
+    if (parser.i != parser.str.size())
+        return parser.fail(JsonError::TRAILING_CHARACTERS, parser.i);
+
+    return result;
+}
+
+Json Json::parse(const string &in, string &err, JsonParse strategy, int max_depth) {
+    JsonParser parser { in, 0, &err, {}, false, strategy, max_depth, {} };
+    return parse_document(parser);
+}
 
+Json Json::parse(const string &in, JsonError &error, JsonParse strategy, int max_depth) {
+    JsonParser parser { in, 0, nullptr, {}, false, strategy, max_depth, {} };
+    Json result = parse_document(parser);
+    error = parser.error;
     return result;
 }
 
@@ -747,8 +1410,9 @@ Json Json::parse(const string &in, string &err, JsonParse strategy) {
 vector<Json> Json::parse_multi(const string &in,
                                std::string::size_type &parser_stop_pos,
                                string &err,
-                               JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+                               JsonParse strategy,
+                               int max_depth) {
+    JsonParser parser { in, 0, &err, {}, false, strategy, max_depth, {} };
     parser_stop_pos = 0;
     vector<Json> json_vec;
     while (parser.i != in.size() && !parser.failed) {
@@ -765,6 +1429,783 @@ vector<Json> Json::parse_multi(const string &in,
     return json_vec;
 }
 
+/* * * * * * * * * * * * * * * * * * * *
+ * Lazy views
+ */
+
+/* JsonView::Document
+ *
+ * The structural index of a parsed document: one Node per value, in document order, where
+ * an object's members appear as a key node followed by the value's nodes. next is the
+ * index just past a node's subtree, which is how lookups skip over siblings.
+ */
+struct JsonView::Document {
+    struct Node {
+        size_t start;       // offset of the first character
+        size_t end;         // offset just past the last character
+        size_t next;
+        unsigned size;      // elements or members of a container
+        Json::Type type;
+        bool escaped;       // string containing escape sequences
+    };
+
+    const string *in;
+    JsonParse strategy;
+    vector<Node> nodes;
+};
+
+JsonView JsonView::parse(const string &in, string &err, JsonParse strategy, int max_depth) {
+    typedef Document::Node Node;
+
+    auto doc = make_shared<Document>();
+    doc->in = &in;
+    doc->strategy = strategy;
+    vector<Node> &nodes = doc->nodes;
+    vector<size_t> open;        // containers not yet closed
+
+    JsonParser parser { in, 0, &err, {}, false, strategy, max_depth, {} };
+
+    // Record a key and the ':' after it, starting at token ch. Mirrors parse_key().
+    auto index_key = [&](char ch) {
+        if (ch != '"')
+            return parser.fail(JsonError::EXPECTED_KEY, parser.i - 1, false);
+        Node key { parser.i - 1, 0, nodes.size() + 1, 0, Json::STRING, false };
+        if (!parser.skip_string(key.escaped))
+            return false;
+        key.end = parser.i;
+        nodes.push_back(key);
+
+        ch = parser.get_next_token();
+        if (ch != ':')
+            return parser.fail(JsonError::EXPECTED_COLON, parser.i - 1, false);
+        return true;
+    };
+
+    while (true) {
+        if (static_cast<long>(open.size()) > max_depth)
+            return parser.fail(JsonError::EXCEEDED_MAX_DEPTH, parser.i, JsonView());
+
+        char ch = parser.get_next_token();
+        if (parser.failed)
+            return JsonView();
+
+        Node node { parser.i - 1, 0, 0, 0, Json::NUL, false };
+        if (ch == '{' || ch == '[') {
+            node.type = ch == '{' ? Json::OBJECT : Json::ARRAY;
+            open.push_back(nodes.size());
+            nodes.push_back(node);
+
+            ch = parser.get_next_token();
+            if (parser.failed)
+                return JsonView();
+
+            if (ch != (node.type == Json::OBJECT ? '}' : ']')) {
+                if (node.type == Json::OBJECT) {
+                    if (!index_key(ch))
+                        return JsonView();
+                } else {
+                    parser.i--;
+                }
+                continue;
+            }
+
+            nodes.back().end = parser.i;
+            nodes.back().next = nodes.size();
+            open.pop_back();
+        } else {
+            if (ch == '"') {
+                node.type = Json::STRING;
+                parser.skip_string(node.escaped);
+            } else if (ch == '-' || (ch >= '0' && ch <= '9')) {
+                node.type = Json::NUMBER;
+                bool integral;
+                parser.i--;
+                parser.scan_number(integral);
+            } else if (ch == 't' || ch == 'f') {
+                node.type = Json::BOOL;
+                parser.expect(ch == 't' ? "true" : "false", Json());
+            } else if (ch == 'n') {
+                parser.expect("null", Json());
+            } else {
+                parser.fail(JsonError::EXPECTED_VALUE, parser.i - 1);
+            }
+            if (parser.failed)
+                return JsonView();
+
+            node.end = parser.i;
+            node.next = nodes.size() + 1;
+            nodes.push_back(node);
+        }
+
+        // A value is complete: count it in its container, closing every container that
+        // ends right after it. Mirrors parse_json().
+        while (!open.empty()) {
+            Node &container = nodes[open.back()];
+            const bool is_object = container.type == Json::OBJECT;
+            container.size++;
+
+            ch = parser.get_next_token();
+            if (ch == (is_object ? '}' : ']')) {
+                container.end = parser.i;
+                container.next = nodes.size();
+                open.pop_back();
+                continue;
+            }
+
+            if (ch != ',') {
+                return parser.fail(is_object ? JsonError::EXPECTED_OBJECT_SEPARATOR
+                                             : JsonError::EXPECTED_ARRAY_SEPARATOR,
+                                   parser.i - 1, JsonView());
+            }
+
+            if (is_object && !index_key(parser.get_next_token()))
+                return JsonView();
+            break;
+        }
+
+        if (open.empty())
+            break;
+    }
+
+    // Check for any trailing garbage
+    parser.consume_garbage();
+    if (parser.failed)
+        return JsonView();
+    if (parser.i != in.size())
+        return parser.fail(JsonError::TRAILING_CHARACTERS, parser.i, JsonView());
+
+    return JsonView(doc, 0);
+}
+
+Json::Type JsonView::type() const {
+    return m_doc ? m_doc->nodes[m_node].type : Json::NUL;
+}
+
+double JsonView::number_value() const {
+    if (!is_number())
+        return 0;
+    return std::strtod(m_doc->in->c_str() + m_doc->nodes[m_node].start, nullptr);
+}
+
+int JsonView::int_value() const {
+    return static_cast<int>(number_value());
+}
+
+bool JsonView::bool_value() const {
+    return is_bool() && (*m_doc->in)[m_doc->nodes[m_node].start] == 't';
+}
+
+string JsonView::string_value() const {
+    if (!is_string())
+        return string();
+
+    const Document::Node &node = m_doc->nodes[m_node];
+    if (!node.escaped)
+        return m_doc->in->substr(node.start + 1, node.end - node.start - 2);
+
+    string err;
+    JsonParser parser { *m_doc->in, node.start + 1, &err, {}, false, m_doc->strategy, 0, {} };
+    return parser.parse_string();
+}
+
+size_t JsonView::size() const {
+    return is_array() || is_object() ? m_doc->nodes[m_node].size : 0;
+}
+
+JsonView JsonView::operator[](size_t i) const {
+    if (!is_array() || i >= size())
+        return JsonView();
+
+    size_t child = m_node + 1;
+    while (i--)
+        child = m_doc->nodes[child].next;
+    return JsonView(m_doc, child);
+}
+
+JsonView JsonView::operator[](const string &key) const {
+    if (!is_object())
+        return JsonView();
+
+    // Like Json::parse, the last of several members with the same key wins.
+    const string &in = *m_doc->in;
+    JsonView found;
+    size_t child = m_node + 1;
+    for (unsigned k = 0; k < m_doc->nodes[m_node].size; k++) {
+        const Document::Node &name = m_doc->nodes[child];
+        const size_t len = name.end - name.start - 2;
+        if (name.escaped ? JsonView(m_doc, child).string_value() == key
+                         : len == key.size() && in.compare(name.start + 1, len, key) == 0)
+            found = JsonView(m_doc, child + 1);
+        child = m_doc->nodes[child + 1].next;
+    }
+    return found;
+}
+
+Json JsonView::to_json() const {
+    if (!m_doc)
+        return Json();
+
+    // The subtree was already checked, and is no deeper than the whole document.
+    const Document::Node &node = m_doc->nodes[m_node];
+    string err;
+    return Json::parse(m_doc->in->substr(node.start, node.end - node.start), err,
+                       m_doc->strategy, std::numeric_limits<int>::max());
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Typed reading
+ */
+
+struct JsonReader::Impl {
+    JsonParser parser;
+    int depth;
+    bool first;     // the container just opened has not had next_element/next_member yet
+    string key;     // decoded key, if it had escapes
+
+    // Return the next token without consuming it.
+    char peek() {
+        char ch = parser.get_next_token();
+        if (!parser.failed)
+            parser.i--;
+        return ch;
+    }
+
+    bool open(char bracket, JsonError::Code mismatch) {
+        char ch = parser.get_next_token();
+        if (parser.failed)
+            return false;
+        if (ch != bracket)
+            return parser.fail(mismatch, parser.i - 1, false);
+        if (++depth > parser.max_depth)
+            return parser.fail(JsonError::EXCEEDED_MAX_DEPTH, parser.i, false);
+        first = true;
+        return true;
+    }
+
+    // Consume the ',' or closing bracket after a member or element. Return false at the
+    // end of the container or on error.
+    bool next(char bracket, JsonError::Code separator) {
+        if (parser.failed)
+            return false;
+        char ch = parser.get_next_token();
+        if (parser.failed)
+            return false;
+        if (ch == bracket) {
+            first = false;
+            depth--;
+            return false;
+        }
+        if (first) {
+            first = false;
+            parser.i--;
+            return true;
+        }
+        if (ch != ',')
+            return parser.fail(separator, parser.i - 1, false);
+        return true;
+    }
+};
+
+JsonReader::JsonReader(const string &in, string &err, JsonParse strategy, int max_depth)
+    : m_impl(new Impl { JsonParser { in, 0, &err, {}, false, strategy, max_depth, {} }, 0, false, {} }) {}
+
+JsonReader::~JsonReader() {}
+
+bool JsonReader::failed() const {
+    return m_impl->parser.failed;
+}
+
+bool JsonReader::read(double &out) {
+    JsonParser &parser = m_impl->parser;
+    char ch = parser.get_next_token();
+    if (parser.failed)
+        return false;
+    if (ch != '-' && !in_range(ch, '0', '9'))
+        return parser.fail(JsonError::EXPECTED_NUMBER, parser.i - 1, false);
+
+    const size_t start = --parser.i;
+    bool integral;
+    if (!parser.scan_number(integral))
+        return false;
+    out = std::strtod(parser.str.c_str() + start, nullptr);
+    return true;
+}
+
+bool JsonReader::read(int &out) {
+    JsonParser &parser = m_impl->parser;
+    char ch = parser.get_next_token();
+    if (parser.failed)
+        return false;
+    if (ch != '-' && !in_range(ch, '0', '9'))
+        return parser.fail(JsonError::EXPECTED_NUMBER, parser.i - 1, false);
+
+    // Same conversion as Json::int_value() on the parsed number.
+    const size_t start = --parser.i;
+    bool integral;
+    if (!parser.scan_number(integral))
+        return false;
+    if (integral && (parser.i - start) <= static_cast<size_t>(std::numeric_limits<int>::digits10))
+        out = std::atoi(parser.str.c_str() + start);
+    else
+        out = static_cast<int>(std::strtod(parser.str.c_str() + start, nullptr));
+    return true;
+}
+
+bool JsonReader::read(bool &out) {
+    JsonParser &parser = m_impl->parser;
+    char ch = parser.get_next_token();
+    if (parser.failed)
+        return false;
+    if (ch != 't' && ch != 'f')
+        return parser.fail(JsonError::EXPECTED_BOOL, parser.i - 1, false);
+    out = parser.parse_scalar(ch).bool_value();
+    return !parser.failed;
+}
+
+bool JsonReader::read(string &out) {
+    JsonParser &parser = m_impl->parser;
+    char ch = parser.get_next_token();
+    if (parser.failed)
+        return false;
+    if (ch != '"')
+        return parser.fail(JsonError::EXPECTED_STRING, parser.i - 1, false);
+    out = parser.parse_string();
+    return !parser.failed;
+}
+
+bool JsonReader::read(Json &out) {
+    out = m_impl->parser.parse_json(m_impl->depth);
+    return !m_impl->parser.failed;
+}
+
+/* skip()
+ *
+ * The closing brackets of the containers skip() has opened are kept in a string rather than
+ * on the call stack, so like parse_json() the nesting it can skip is bounded by max_depth and
+ * the heap.
+ */
+bool JsonReader::skip() {
+    JsonParser &parser = m_impl->parser;
+    string closers;
+    do {
+        switch (m_impl->peek()) {
+        case '{':
+            if (!begin_object())
+                return false;
+            closers.push_back('}');
+            break;
+        case '[':
+            if (!begin_array())
+                return false;
+            closers.push_back(']');
+            break;
+        case '"': {
+            parser.i++;
+            bool escaped;
+            parser.skip_string(escaped);
+            break;
+        }
+        default:
+            if (!parser.failed)
+                parser.parse_scalar(parser.get_next_token());
+            break;
+        }
+        if (parser.failed)
+            return false;
+
+        // Step to the next member or element, closing the containers that end first.
+        while (!closers.empty()) {
+            const char *key;
+            size_t len;
+            if (closers.back() == '}' ? next_member(key, len) : next_element())
+                break;
+            if (parser.failed)
+                return false;
+            closers.pop_back();
+        }
+    } while (!closers.empty());
+    return true;
+}
+
+bool JsonReader::begin_array() {
+    return m_impl->open('[', JsonError::EXPECTED_ARRAY);
+}
+
+bool JsonReader::next_element() {
+    return m_impl->next(']', JsonError::EXPECTED_ARRAY_SEPARATOR);
+}
+
+bool JsonReader::begin_object() {
+    return m_impl->open('{', JsonError::EXPECTED_OBJECT);
+}
+
+bool JsonReader::next_member(const char *&key, size_t &len) {
+    if (!m_impl->next('}', JsonError::EXPECTED_OBJECT_SEPARATOR))
+        return false;
+
+    JsonParser &parser = m_impl->parser;
+    char ch = parser.get_next_token();
+    if (ch != '"')
+        return parser.fail(JsonError::EXPECTED_KEY, parser.i - 1, false);
+
+    // Keys without escapes are used in place; only escaped ones are decoded.
+    const size_t start = parser.i;
+    bool escaped;
+    if (!parser.skip_string(escaped))
+        return false;
+    if (escaped) {
+        parser.i = start;
+        m_impl->key = parser.parse_string();
+        key = m_impl->key.data();
+        len = m_impl->key.size();
+    } else {
+        key = parser.str.data() + start;
+        len = parser.i - 1 - start;
+    }
+
+    ch = parser.get_next_token();
+    if (ch != ':')
+        return parser.fail(JsonError::EXPECTED_COLON, parser.i - 1, false);
+    return true;
+}
+
+bool JsonReader::finish() {
+    JsonParser &parser = m_impl->parser;
+    parser.consume_garbage();
+    if (parser.failed)
+        return false;
+    if (parser.i != parser.str.size())
+        return parser.fail(JsonError::TRAILING_CHARACTERS, parser.i, false);
+    return true;
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Parallel NDJSON
+ */
+
+namespace {
+/* NdjsonRange
+ *
+ * A run of whole lines of NDJSON input, parsed independently of the others.
+ */
+struct NdjsonRange {
+    size_t begin;
+    size_t end;
+    vector<Json> values;
+    size_t lines;           // lines parsed, including the failing one
+    string err;
+
+    void parse(const string &in, JsonParse strategy, int max_depth) {
+        string line;
+        size_t pos = begin;
+        while (pos < end) {
+            const char *nl = static_cast<const char *>(memchr(in.data() + pos, '\n', end - pos));
+            const size_t line_end = nl ? static_cast<size_t>(nl - in.data()) : end;
+            lines++;
+
+            // A raw newline can never appear inside a valid string (it would be escaped as
+            // \n), so splitting on it never cuts a value in two.
+            if (in.find_first_not_of(" \t\r", pos) < line_end) {
+                line.assign(in, pos, line_end - pos);
+                values.push_back(Json::parse(line, err, strategy, max_depth));
+                if (!err.empty())
+                    return;
+            }
+            pos = line_end + 1;
+        }
+    }
+};
+}
+
+// Documented in json11.hpp
+vector<Json> Json::parse_ndjson(const string &in,
+                                string &err,
+                                unsigned num_threads,
+                                JsonParse strategy,
+                                int max_depth) {
+    // Keep ranges large enough that starting a thread is worth it.
+    static const size_t min_range_size = 64 * 1024;
+
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = static_cast<unsigned>(
+        std::min<size_t>(num_threads, in.size() / min_range_size + 1));
+
+    // Split at the first newline at or after each evenly spaced offset.
+    vector<NdjsonRange> ranges;
+    size_t begin = 0;
+    for (unsigned k = 1; k <= num_threads && begin < in.size(); k++) {
+        size_t end = in.size();
+        if (k < num_threads) {
+            const size_t target = std::max(begin, in.size() / num_threads * k);
+            const size_t nl = in.find('\n', target);
+            if (nl != string::npos)
+                end = nl + 1;
+        }
+        ranges.push_back(NdjsonRange { begin, end, {}, 0, {} });
+        begin = end;
+    }
+
+    vector<std::thread> threads;
+    for (size_t k = 1; k < ranges.size(); k++) {
+        NdjsonRange *range = &ranges[k];
+        threads.emplace_back([range, &in, strategy, max_depth] {
+            range->parse(in, strategy, max_depth);
+        });
+    }
+    if (!ranges.empty())
+        ranges[0].parse(in, strategy, max_depth);
+    for (auto &thread : threads)
+        thread.join();
+
+    size_t total = 0;
+    for (const auto &range : ranges)
+        total += range.values.size();
+
+    vector<Json> json_vec;
+    json_vec.reserve(total);
+    size_t line_base = 0;
+    for (auto &range : ranges) {
+        if (!range.err.empty()) {
+            // The failing line's placeholder value is dropped.
+            range.values.pop_back();
+            std::move(range.values.begin(), range.values.end(), std::back_inserter(json_vec));
+            err = "line " + std::to_string(line_base + range.lines) + ": " + range.err;
+            break;
+        }
+        std::move(range.values.begin(), range.values.end(), std::back_inserter(json_vec));
+        line_base += range.lines;
+    }
+    return json_vec;
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Streaming
+ */
+
+JsonStreamParser::JsonStreamParser(JsonParse strategy, int max_depth)
+    : m_strategy(strategy), m_max_depth(max_depth) {}
+
+void JsonStreamParser::feed(const char * data, size_t len) {
+    // Drop the input that has already been parsed before growing the buffer.
+    if (m_pos > 0) {
+        m_buf.erase(0, m_pos);
+        m_scan -= m_pos;
+        if (m_comment == BLOCK_COMMENT)
+            m_comment_body -= m_pos;
+        m_pos = 0;
+    }
+    m_buf.append(data, len);
+}
+
+void JsonStreamParser::reset_scan() {
+    m_scan = m_pos;
+    m_depth = 0;
+    m_comment = NO_COMMENT;
+    m_in_string = m_escape = m_in_scalar = m_slash = false;
+}
+
+/* scan(end)
+ *
+ * Look for the end of the next top-level value, resuming where the previous call stopped.
+ * This only tracks strings, comments and bracket depth; the value itself is validated by
+ * JsonParser once it is complete. Return false if more input is needed.
+ */
+bool JsonStreamParser::scan(size_t & end) {
+    const size_t size = m_buf.size();
+    for (; m_scan < size; m_scan++) {
+        const char ch = m_buf[m_scan];
+
+        if (m_in_string) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (ch == '\\') {
+                m_escape = true;
+            } else if (ch == '"') {
+                m_in_string = false;
+                if (m_depth == 0) {
+                    end = m_scan + 1;
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        if (m_comment == LINE_COMMENT) {
+            if (ch == '\n')
+                m_comment = NO_COMMENT;
+            continue;
+        }
+        if (m_comment == BLOCK_COMMENT) {
+            if (ch == '/' && m_scan > m_comment_body && m_buf[m_scan - 1] == '*')
+                m_comment = NO_COMMENT;
+            continue;
+        }
+        if (m_slash) {
+            m_slash = false;
+            if (ch == '/') {
+                m_comment = LINE_COMMENT;
+                continue;
+            }
+            if (ch == '*') {
+                m_comment = BLOCK_COMMENT;
+                m_comment_body = m_scan + 1;
+                continue;
+            }
+            // Malformed comment: let the parser report it.
+            end = size;
+            return true;
+        }
+
+        const bool is_delimiter = ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n'
+            || ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ',' || ch == ':'
+            || ch == '"' || ch == '/';
+
+        if (m_in_scalar) {
+            if (!is_delimiter)
+                continue;
+            end = m_scan;
+            return true;
+        }
+
+        if (ch == '/' && m_strategy == JsonParse::COMMENTS) {
+            m_slash = true;
+        } else if (ch == '"') {
+            m_in_string = true;
+        } else if (ch == '{' || ch == '[') {
+            m_depth++;
+        } else if (m_depth > 0) {
+            if ((ch == '}' || ch == ']') && --m_depth == 0) {
+                end = m_scan + 1;
+                return true;
+            }
+        } else if (!is_delimiter) {
+            m_in_scalar = true;
+        } else if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') {
+            // Nothing valid starts here: let the parser report it.
+            end = size;
+            return true;
+        }
+    }
+
+    if (m_in_scalar && m_finished) {
+        end = size;
+        return true;
+    }
+    return false;
+}
+
+bool JsonStreamParser::next(Json & out, string & err) {
+    if (!m_err.empty()) {
+        err = m_err;
+        return false;
+    }
+
+    size_t end;
+    if (!scan(end)) {
+        if (!m_finished || m_pos == m_buf.size())
+            return false;
+        // The input ended inside a value or comment; parsing the rest reports why.
+        end = m_buf.size();
+    }
+
+    m_record.assign(m_buf, m_pos, end - m_pos);
+    JsonParser parser { m_record, 0, &m_err, {}, false, m_strategy, m_max_depth, {} };
+    parser.consume_garbage();
+    if (!parser.failed && parser.i == m_record.size()) {
+        // Only whitespace and comments were left.
+        m_pos = end;
+        reset_scan();
+        return false;
+    }
+
+    Json value = parser.parse_json(0);
+    if (parser.failed) {
+        err = m_err;
+        return false;
+    }
+
+    // The parser may stop short of end when scalars are concatenated ("truefalse").
+    m_pos += parser.i;
+    reset_scan();
+    out = move(value);
+    return true;
+}
+
+bool JsonStreamParser::parse_stream(const std::function<size_t(char *, size_t)> & read,
+                                    const std::function<void(Json &&)> & on_value,
+                                    string & err,
+                                    JsonParse strategy,
+                                    int max_depth) {
+    JsonStreamParser stream(strategy, max_depth);
+    vector<char> chunk(64 * 1024);
+    Json value;
+    while (true) {
+        const size_t len = read(chunk.data(), chunk.size());
+        if (len == 0)
+            stream.finish();
+        else
+            stream.feed(chunk.data(), len);
+
+        while (stream.next(value, err))
+            on_value(move(value));
+        if (!err.empty())
+            return false;
+        if (len == 0)
+            return true;
+    }
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Persistent updates
+ */
+
+// A number steps into an array only as a non-negative integer that fits in an int, like
+// int_value(); anything else would be undefined to convert, or pad the array without bound.
+static bool path_index(const Json &step, size_t &index) {
+    const double d = step.number_value();
+    if (!(d >= 0 && d <= std::numeric_limits<int>::max() && std::floor(d) == d))
+        return false;
+    index = static_cast<size_t>(d);
+    return true;
+}
+
+Json Json::with(const array &path, Json value) const {
+    // Find the existing value that each path element steps into.
+    vector<const Json *> parents;
+    parents.reserve(path.size());
+    const Json *node = this;
+    for (const Json &step : path) {
+        size_t index;
+        parents.push_back(node);
+        if (step.is_string())
+            node = &(*node)[step.string_value()];
+        else if (step.is_number() && path_index(step, index))
+            node = &(*node)[index];
+        else
+            return *this;
+    }
+
+    // Rebuild the containers along the path, bottom-up.
+    for (size_t k = path.size(); k-- > 0; ) {
+        const Json &step = path[k];
+        if (step.is_string()) {
+            Json::object items = parents[k]->object_items();
+            items[step.string_value()] = move(value);
+            value = Json(move(items));
+        } else {
+            Json::array items = parents[k]->array_items();
+            size_t index = 0;
+            path_index(step, index);
+            if (index >= items.size())
+                items.resize(index + 1);
+            items[index] = move(value);
+            value = Json(move(items));
+        }
+    }
+    return value;
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Shape-checking
  */
@@ -787,4 +2228,106 @@ bool Json::has_shape(const shape & types, string & err) const {
     return true;
 }
 
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Compiled shapes
+ */
+
+static const char * type_name(Json::Type type) {
+    switch (type) {
+    case Json::NUL:    return "null";
+    case Json::NUMBER: return "number";
+    case Json::BOOL:   return "bool";
+    case Json::STRING: return "string";
+    case Json::ARRAY:  return "array";
+    case Json::OBJECT: return "object";
+    }
+    return "value";
+}
+
+JsonShape::JsonShape(Json::Type type) : m_type(type) {}
+
+JsonShape::JsonShape(initializer_list<std::pair<string, JsonShape>> fields)
+    : m_type(Json::OBJECT) {
+    for (const auto &field : fields) {
+#ifdef JSON11_ORDERED_OBJECT
+        const size_t hash = OrderedObject::hash_key(field.first.data(), field.first.size());
+#else
+        const size_t hash = 0;
+#endif
+        m_fields.push_back(Field { field.first, hash, make_shared<JsonShape>(field.second) });
+    }
+    std::sort(m_fields.begin(), m_fields.end(), [](const Field &a, const Field &b) {
+        return a.key < b.key;
+    });
+}
+
+JsonShape JsonShape::array_of(const JsonShape &element) {
+    JsonShape shape(Json::ARRAY);
+    shape.m_element = make_shared<JsonShape>(element);
+    return shape;
+}
+
+bool JsonShape::member_matches(const Field &field, const Json *member, const Json &object,
+                               string &err) const {
+    if (!member || member->type() != field.shape->m_type) {
+        err = "bad type for " + field.key + " in " + object.dump();
+        return false;
+    }
+    return field.shape->matches(*member, err);
+}
+
+bool JsonShape::matches(const Json &json, string &err) const {
+    if (json.type() != m_type) {
+        err = string("expected JSON ") + type_name(m_type) + ", got " + json.dump();
+        return false;
+    }
+
+    if (m_element) {
+        const Json::array &items = json.array_items();
+        for (size_t i = 0; i < items.size(); i++) {
+            if (items[i].type() != m_element->m_type) {
+                err = "bad type for element " + std::to_string(i) + " in " + json.dump();
+                return false;
+            }
+            if (!m_element->matches(items[i], err))
+                return false;
+        }
+        return true;
+    }
+
+    if (m_fields.empty())
+        return true;
+
+    const Json::object &items = json.object_items();
+#ifdef JSON11_ORDERED_OBJECT
+    for (const Field &field : m_fields) {
+        const auto it = items.find(field.key.data(), field.key.size(), field.hash);
+        if (!member_matches(field, it == items.end() ? nullptr : &it->second, json, err))
+            return false;
+    }
+#else
+    if (items.size() > 4 * m_fields.size()) {
+        for (const Field &field : m_fields) {
+            const auto it = items.find(field.key);
+            if (!member_matches(field, it == items.end() ? nullptr : &it->second, json, err))
+                return false;
+        }
+        return true;
+    }
+
+    // Both the fields and the map are sorted by key, so walk them together rather than
+    // doing a tree lookup per field.
+    auto it = items.begin();
+    for (const Field &field : m_fields) {
+        while (it != items.end() && it->first < field.key)
+            ++it;
+        const bool found = it != items.end() && it->first == field.key;
+        if (!member_matches(field, found ? &it->second : nullptr, json, err))
+            return false;
+    }
+#endif
+    return true;
+}
+
 } // namespace json11
@@ -4,7 +4,7 @@
  *
  * The core object provided by the library is json11::Json. A Json object represents any JSON
  * value: null, bool, number (int or double), string (std::string), array (std::vector), or
- * object (std::map).
+ * object (std::map, or json11::OrderedObject when JSON11_ORDERED_OBJECT is defined).
  *
  * Json objects act like values: they can be assigned, copied, moved, compared for equality or
  * order, etc. There are also helper methods Json::dump, to serialize a Json to a string, and
@@ -54,8 +54,17 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
 #include <initializer_list>
 
+#ifdef JSON11_ORDERED_OBJECT
+    #include <cstdint>
+    #if __cplusplus >= 201703L
+        #include <string_view>
+        #define JSON11_HAS_STRING_VIEW 1
+    #endif
+#endif
+
 #ifdef _MSC_VER
     #if _MSC_VER <= 1800 // VS 2013
         #ifndef noexcept
@@ -74,7 +83,56 @@ enum JsonParse {
     STANDARD, COMMENTS
 };
 
+/* JsonError
+ *
+ * Why and where a parse failed, recorded as a code and the byte offset the error refers to.
+ * Parsing into a JsonError never formats a message, which makes rejecting bad input cheap;
+ * message() produces the text the string-reporting functions would have given.
+ */
+struct JsonError {
+    enum Code {
+        NONE,
+        UNEXPECTED_END,                 // end of input where a token was expected
+        UNEXPECTED_END_IN_STRING,
+        UNEXPECTED_END_IN_COMMENT,
+        UNEXPECTED_END_AFTER_SLASH,     // a '/' at the end of input (COMMENTS only)
+        MALFORMED_COMMENT,              // a '/' not followed by '/' or '*' (COMMENTS only)
+        UNESCAPED_CONTROL_CHARACTER,
+        BAD_UNICODE_ESCAPE,
+        INVALID_ESCAPE,
+        LEADING_ZERO,
+        INVALID_NUMBER,
+        MISSING_FRACTION_DIGITS,
+        MISSING_EXPONENT_DIGITS,
+        INVALID_LITERAL,                // something other than true, false or null
+        EXPECTED_VALUE,
+        EXPECTED_KEY,
+        EXPECTED_COLON,
+        EXPECTED_OBJECT_SEPARATOR,      // neither ',' nor '}' after a member
+        EXPECTED_ARRAY_SEPARATOR,       // neither ',' nor ']' after an element
+        EXCEEDED_MAX_DEPTH,
+        TRAILING_CHARACTERS,
+        // Type mismatches reported by JsonReader
+        EXPECTED_NUMBER,
+        EXPECTED_BOOL,
+        EXPECTED_STRING,
+        EXPECTED_ARRAY,
+        EXPECTED_OBJECT,
+    };
+
+    Code code = NONE;
+    size_t offset = 0;
+
+    explicit operator bool() const { return code != NONE; }
+
+    // Format the error message. in must be the input that was parsed.
+    std::string message(const std::string & in) const;
+};
+
 class JsonValue;
+#ifdef JSON11_ORDERED_OBJECT
+class OrderedObject;
+#endif
 
 class Json final {
 public:
@@ -85,7 +143,11 @@ public:
 
     // Array and object typedefs
     typedef std::vector<Json> array;
+#ifdef JSON11_ORDERED_OBJECT
+    typedef OrderedObject object;
+#else
     typedef std::map<std::string, Json> object;
+#endif
 
     // Constructors for the various types of JSON value.
     Json() noexcept;                // NUL
@@ -144,7 +206,7 @@ public:
     const std::string &string_value() const;
     // Return the enclosed std::vector if this is an array, or an empty vector otherwise.
     const array &array_items() const;
-    // Return the enclosed std::map if this is an object, or an empty map otherwise.
+    // Return the enclosed object map if this is an object, or an empty map otherwise.
     const object &object_items() const;
 
     // Return a reference to arr[i] if this is an array, Json() otherwise.
@@ -160,35 +222,74 @@ public:
         return out;
     }
 
+    // Serialize this array or object once and keep the bytes in its node, so later dumps
+    // of it - on its own or inside an enclosing value, through any copy of this Json - copy
+    // them instead of walking the subtree. Values are immutable, so the cached bytes never
+    // go stale. Worth calling on large subtrees that are shared between many dumped values.
+    // No-op for other types.
+    void cache_dump() const;
+
+    // Default limit on how deeply arrays and objects may nest in parsed input. Nesting is
+    // tracked on the heap rather than the call stack, so larger limits are safe to pass.
+    static const int default_max_depth = 200;
+
     // Parse. If parse fails, return Json() and assign an error message to err.
     static Json parse(const std::string & in,
                       std::string & err,
-                      JsonParse strategy = JsonParse::STANDARD);
+                      JsonParse strategy = JsonParse::STANDARD,
+                      int max_depth = default_max_depth);
     static Json parse(const char * in,
                       std::string & err,
-                      JsonParse strategy = JsonParse::STANDARD) {
+                      JsonParse strategy = JsonParse::STANDARD,
+                      int max_depth = default_max_depth) {
         if (in) {
-            return parse(std::string(in), err, strategy);
+            return parse(std::string(in), err, strategy, max_depth);
         } else {
             err = "null input";
             return nullptr;
         }
     }
+    // Parse, recording only an error code and offset if parse fails; see JsonError. On
+    // success, error is reset to JsonError::NONE.
+    static Json parse(const std::string & in,
+                      JsonError & error,
+                      JsonParse strategy = JsonParse::STANDARD,
+                      int max_depth = default_max_depth);
     // Parse multiple objects, concatenated or separated by whitespace
     static std::vector<Json> parse_multi(
         const std::string & in,
         std::string::size_type & parser_stop_pos,
         std::string & err,
-        JsonParse strategy = JsonParse::STANDARD);
+        JsonParse strategy = JsonParse::STANDARD,
+        int max_depth = default_max_depth);
 
     static inline std::vector<Json> parse_multi(
         const std::string & in,
         std::string & err,
-        JsonParse strategy = JsonParse::STANDARD) {
+        JsonParse strategy = JsonParse::STANDARD,
+        int max_depth = default_max_depth) {
         std::string::size_type parser_stop_pos;
-        return parse_multi(in, parser_stop_pos, err, strategy);
+        return parse_multi(in, parser_stop_pos, err, strategy, max_depth);
     }
 
+    // Parse newline-delimited JSON (one value per line, blank lines skipped), splitting the
+    // input at line boundaries and parsing the ranges on up to num_threads threads (0 means
+    // one per hardware thread). Values are returned in input order. If a line fails to
+    // parse, err is set to its message prefixed with the line number, and only the values
+    // of the lines before it are returned. With JsonParse::COMMENTS, block comments must
+    // not span lines. This uses std::thread, so build and link with -pthread.
+    static std::vector<Json> parse_ndjson(
+        const std::string & in,
+        std::string & err,
+        unsigned num_threads = 0,
+        JsonParse strategy = JsonParse::STANDARD,
+        int max_depth = default_max_depth);
+
+    // Structural hash, consistent with operator==. Arrays and objects compute theirs once and
+    // cache it in the (immutable) node; once two containers both have one, operator== can
+    // usually tell them apart without walking them.
+    size_t hash() const;
+
     bool operator== (const Json &rhs) const;
     bool operator<  (const Json &rhs) const;
     bool operator!= (const Json &rhs) const { return !(*this == rhs); }
@@ -204,10 +305,428 @@ public:
     typedef std::initializer_list<std::pair<std::string, Type>> shape;
     bool has_shape(const shape & types, std::string & err) const;
 
+    /* with(path, value)
+     *
+     * Return a copy of this value in which the value at path is replaced by value. Each path
+     * element is either a string, naming an object member, or an integer from 0 to INT_MAX,
+     * indexing an array. Members that do not exist are added, arrays are padded with nulls up
+     * to an index past their end, and a step into a value of the wrong type replaces it with a
+     * new object or array. If an element has any other type, *this is returned.
+     *
+     * Json values are immutable, so everything off the path is shared with this value: only
+     * the containers along the path are copied, and their untouched children are shared.
+     */
+    Json with(const array & path, Json value) const;
+
 private:
     std::shared_ptr<JsonValue> m_ptr;
 };
 
+#ifdef JSON11_ORDERED_OBJECT
+/* OrderedObject
+ *
+ * The Json::object container when JSON11_ORDERED_OBJECT is defined. Members stay in
+ * insertion order (so parsing and dumping an object keeps its key order) in a flat vector,
+ * and lookups go through an open-addressing hash index once the object is too large for a
+ * linear scan. It provides the parts of the std::map interface that object_items() callers
+ * rely on, plus lookup by (pointer, length) or std::string_view without building a string.
+ *
+ * As with std::map, inserting a key that is already present keeps the existing member.
+ * Equality ignores member order. Keys must not be modified through iterators.
+ */
+class OrderedObject final {
+public:
+    typedef std::string key_type;
+    typedef Json mapped_type;
+    typedef std::pair<std::string, Json> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    typedef std::vector<value_type>::size_type size_type;
+
+    OrderedObject() {}
+    OrderedObject(std::initializer_list<value_type> values) {
+        for (const auto &kv : values)
+            insert(kv);
+    }
+    template <class It>
+    OrderedObject(It first, It last) {
+        for (; first != last; ++first)
+            insert(value_type(first->first, first->second));
+    }
+
+    iterator begin()              { return m_items.begin(); }
+    iterator end()                { return m_items.end(); }
+    const_iterator begin()  const { return m_items.begin(); }
+    const_iterator end()    const { return m_items.end(); }
+    const_iterator cbegin() const { return m_items.cbegin(); }
+    const_iterator cend()   const { return m_items.cend(); }
+
+    size_type size() const { return m_items.size(); }
+    bool empty()     const { return m_items.empty(); }
+    void reserve(size_type n) { m_items.reserve(n); }
+    void clear() {
+        m_items.clear();
+        m_slots.clear();
+    }
+
+    iterator find(const char * key, size_t len) {
+        return m_items.begin() + static_cast<std::ptrdiff_t>(lookup(key, len));
+    }
+    const_iterator find(const char * key, size_t len) const {
+        return m_items.begin() + static_cast<std::ptrdiff_t>(lookup(key, len));
+    }
+    // Lookup with a key hash precomputed by hash_key(), for keys searched for repeatedly.
+    const_iterator find(const char * key, size_t len, size_t hash) const {
+        return m_items.begin() + static_cast<std::ptrdiff_t>(lookup(key, len, hash));
+    }
+    static size_t hash_key(const char * key, size_t len);
+#if JSON11_HAS_STRING_VIEW
+    iterator find(std::string_view key)              { return find(key.data(), key.size()); }
+    const_iterator find(std::string_view key)  const { return find(key.data(), key.size()); }
+    size_type count(std::string_view key)      const { return find(key) != end() ? 1 : 0; }
+    const Json & at(std::string_view key)      const;
+#else
+    iterator find(const std::string & key)             { return find(key.data(), key.size()); }
+    const_iterator find(const std::string & key) const { return find(key.data(), key.size()); }
+    size_type count(const std::string & key)     const { return find(key) != end() ? 1 : 0; }
+    const Json & at(const std::string & key)     const;
+#endif
+
+    std::pair<iterator, bool> insert(const value_type & kv) { return insert(value_type(kv)); }
+    std::pair<iterator, bool> insert(value_type && kv);
+    template <class K, class V>
+    std::pair<iterator, bool> emplace(K && key, V && value) {
+        return insert(value_type(std::forward<K>(key), std::forward<V>(value)));
+    }
+    Json & operator[](const std::string & key) { return (*this)[std::string(key)]; }
+    Json & operator[](std::string && key);
+    size_type erase(const std::string & key);
+
+    bool operator== (const OrderedObject & other) const;
+    bool operator<  (const OrderedObject & other) const;
+    bool operator!= (const OrderedObject & other) const { return !(*this == other); }
+
+private:
+    // A hash index entry: the member's position plus one (0 for an empty slot), and the low
+    // bits of its key's hash.
+    struct Slot {
+        uint32_t entry;
+        uint32_t hash;
+    };
+
+    size_t lookup(const char * key, size_t len) const;
+    size_t lookup(const char * key, size_t len, size_t hash) const;
+    void index_back(size_t hash);
+    void place(size_t entry, size_t hash);
+    void rebuild_index();
+
+    std::vector<value_type> m_items;
+    std::vector<Slot> m_slots;
+};
+#endif
+
+/* JsonShape
+ *
+ * A compiled form of the shapes that Json::has_shape checks, for validating many values
+ * against the same shape. A JsonShape is a type, plus the shapes of required members for an
+ * object or the shape of every element for an array, so it can describe nested documents:
+ *
+ *     JsonShape point { { "x", Json::NUMBER }, { "y", Json::NUMBER } };
+ *     JsonShape path { { "name", Json::STRING }, { "points", JsonShape::array_of(point) } };
+ *
+ * Key sorting and hashing happen once, when the shape is built. matches() makes one pass
+ * over the value and only formats an error message when the value does not match.
+ */
+class JsonShape final {
+public:
+    // Any value of the given type.
+    JsonShape(Json::Type type);
+    // An object with (at least) these members.
+    JsonShape(std::initializer_list<std::pair<std::string, JsonShape>> fields);
+    // An array whose elements all have the given shape.
+    static JsonShape array_of(const JsonShape & element);
+
+    // Return true if json has this shape. If not, return false and set err to a descriptive
+    // message.
+    bool matches(const Json & json, std::string & err) const;
+
+private:
+    struct Field {
+        std::string key;
+        size_t hash;
+        std::shared_ptr<const JsonShape> shape;
+    };
+
+    bool member_matches(const Field & field, const Json * member, const Json & object,
+                        std::string & err) const;
+
+    Json::Type m_type;
+    std::vector<Field> m_fields;    // sorted by key
+    std::shared_ptr<const JsonShape> m_element;
+};
+
+/* JsonStreamParser
+ *
+ * Incremental parser for a stream of JSON values, concatenated or separated by whitespace
+ * (NDJSON, for instance). Input is fed in chunks of any size, and each value can be taken
+ * with next() as soon as its last byte has arrived. Only the unparsed tail of the input is
+ * buffered, so memory stays bounded by the largest single value plus one chunk.
+ */
+class JsonStreamParser final {
+public:
+    explicit JsonStreamParser(JsonParse strategy = JsonParse::STANDARD,
+                              int max_depth = Json::default_max_depth);
+
+    // Append a chunk of input.
+    void feed(const char * data, size_t len);
+    void feed(const std::string & data) { feed(data.data(), data.size()); }
+
+    // Signal the end of input. A top-level number is only known to be complete once the
+    // input that follows it, or the end of input, has been seen.
+    void finish() { m_finished = true; }
+
+    // Store the next complete value in out and return true. Return false if more input is
+    // needed, the input is exhausted, or parsing failed; in the last case err is set.
+    bool next(Json & out, std::string & err);
+
+    // Parse a whole stream, pulling chunks from read(buf, size) - which returns the number
+    // of bytes stored, 0 at end of input - and passing each value to on_value as soon as
+    // it is complete. To read a file descriptor, wrap ::read() in the callback. Return
+    // false and set err if parsing fails.
+    static bool parse_stream(const std::function<size_t(char *, size_t)> & read,
+                             const std::function<void(Json &&)> & on_value,
+                             std::string & err,
+                             JsonParse strategy = JsonParse::STANDARD,
+                             int max_depth = Json::default_max_depth);
+
+private:
+    enum Comment { NO_COMMENT, LINE_COMMENT, BLOCK_COMMENT };
+
+    bool scan(size_t & end);
+    void reset_scan();
+
+    const JsonParse m_strategy;
+    const int m_max_depth;
+    std::string m_buf;      // unparsed input, starting at m_pos
+    std::string m_record;   // the value being handed to the parser
+    std::string m_err;
+    size_t m_pos = 0;
+    size_t m_scan = 0;
+    size_t m_comment_body = 0;
+    int m_depth = 0;
+    Comment m_comment = NO_COMMENT;
+    bool m_in_string = false;
+    bool m_escape = false;
+    bool m_in_scalar = false;
+    bool m_slash = false;
+    bool m_finished = false;
+};
+
+/* JsonView
+ *
+ * Read-only view of a JSON document that decodes values on demand. JsonView::parse checks
+ * the whole input in one pass, exactly as Json::parse would, but only records where each
+ * value starts and ends instead of building Json nodes. Strings and numbers are decoded
+ * when read, and lookups skip over unrelated subtrees using the recorded offsets.
+ *
+ * Views share the index and refer to the parsed string, which must outlive them. A
+ * default-constructed view, or one for a missing element or member, reads as null.
+ */
+class JsonView final {
+public:
+    JsonView() : m_node(0) {}
+
+    // Parse. If parse fails, return an empty view and assign an error message to err.
+    static JsonView parse(const std::string & in,
+                          std::string & err,
+                          JsonParse strategy = JsonParse::STANDARD,
+                          int max_depth = Json::default_max_depth);
+
+    Json::Type type() const;
+
+    bool is_null()   const { return type() == Json::NUL; }
+    bool is_number() const { return type() == Json::NUMBER; }
+    bool is_bool()   const { return type() == Json::BOOL; }
+    bool is_string() const { return type() == Json::STRING; }
+    bool is_array()  const { return type() == Json::ARRAY; }
+    bool is_object() const { return type() == Json::OBJECT; }
+
+    // Same as the Json accessors, decoding the value on each call.
+    double number_value() const;
+    int int_value() const;
+    bool bool_value() const;
+    std::string string_value() const;
+
+    // Return the number of elements or members if this is an array or object, 0 otherwise.
+    size_t size() const;
+
+    // Return a view of arr[i] if this is an array, a null view otherwise.
+    JsonView operator[](size_t i) const;
+    // Return a view of obj[key] if this is an object, a null view otherwise.
+    JsonView operator[](const std::string &key) const;
+
+    // Build the Json value for this view.
+    Json to_json() const;
+
+private:
+    struct Document;
+    JsonView(const std::shared_ptr<const Document> & doc, size_t node)
+        : m_doc(doc), m_node(node) {}
+
+    std::shared_ptr<const Document> m_doc;
+    size_t m_node;
+};
+
+/* JsonReader
+ *
+ * Pull parser that reads JSON text straight into C++ values, without building Json nodes.
+ * Each read consumes one value and returns false, setting err, if the input is malformed
+ * or the value has the wrong type; once a read has failed, all later reads fail too.
+ * Most code uses it through from_json() below rather than directly.
+ *
+ * The reader refers to the input string, which must outlive it.
+ */
+class JsonReader final {
+public:
+    JsonReader(const std::string & in,
+               std::string & err,
+               JsonParse strategy = JsonParse::STANDARD,
+               int max_depth = Json::default_max_depth);
+    ~JsonReader();
+
+    bool read(double & out);
+    bool read(int & out);
+    bool read(bool & out);
+    bool read(std::string & out);
+    // Read any value as a Json.
+    bool read(Json & out);
+    // Consume a value of any type without decoding it.
+    bool skip();
+
+    // Consume the '[' of an array. Then, while next_element() returns true, read one
+    // element; it returns false after the closing ']' or on error.
+    bool begin_array();
+    bool next_element();
+
+    // Consume the '{' of an object. Then, while next_member() returns true, read the value
+    // of the member named key. The key points into the input, or into the reader if it had
+    // escapes, and stays valid until the next call. Returns false after the closing '}' or
+    // on error.
+    bool begin_object();
+    bool next_member(const char *& key, size_t & len);
+
+    // Check that nothing but whitespace (and comments, if enabled) follows the last value.
+    bool finish();
+
+    bool failed() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/* JsonField<T>
+ *
+ * One entry of a type's field table: a member name and a function that reads the member
+ * from a JsonReader. A struct becomes readable by from_json() by listing its fields in a
+ * static json_fields() function, in the order they usually appear in the input:
+ *
+ *     struct Point {
+ *         double x, y;
+ *         static const std::vector<json11::JsonField<Point>> & json_fields() {
+ *             static const std::vector<json11::JsonField<Point>> fields {
+ *                 JSON11_FIELD(Point, x), JSON11_FIELD(Point, y),
+ *             };
+ *             return fields;
+ *         }
+ *     };
+ *
+ * Members missing from the input keep their current value; unknown members are skipped.
+ */
+template <class T>
+struct JsonField {
+    const char * name;
+    size_t len;
+    bool (*read)(JsonReader & reader, T & out);
+};
+
+#define JSON11_FIELD(Type, member) \
+    json11::JsonField<Type> { #member, sizeof(#member) - 1, \
+        [](json11::JsonReader & reader, Type & out) -> bool { \
+            using json11::from_json; \
+            return from_json(reader, out.member); \
+        } }
+
+/* from_json(reader, out)
+ *
+ * Read one value into out. Overloads cover the types Json stores, vectors of readable
+ * types and structs with a json_fields() table; further types can be supported by
+ * overloading from_json() in their own namespace.
+ */
+inline bool from_json(JsonReader & reader, double & out) { return reader.read(out); }
+inline bool from_json(JsonReader & reader, int & out) { return reader.read(out); }
+inline bool from_json(JsonReader & reader, bool & out) { return reader.read(out); }
+inline bool from_json(JsonReader & reader, std::string & out) { return reader.read(out); }
+inline bool from_json(JsonReader & reader, Json & out) { return reader.read(out); }
+
+template <class T>
+bool from_json(JsonReader & reader, std::vector<T> & out) {
+    out.clear();
+    if (!reader.begin_array())
+        return false;
+    while (reader.next_element()) {
+        out.emplace_back();
+        if (!from_json(reader, out.back()))
+            return false;
+    }
+    return !reader.failed();
+}
+
+template <class T>
+auto from_json(JsonReader & reader, T & out) -> decltype(T::json_fields(), bool()) {
+    const auto & fields = T::json_fields();
+    const size_t count = fields.size();
+    if (!reader.begin_object())
+        return false;
+
+    // Members usually arrive in table order, so start looking just after the last match.
+    size_t hint = 0;
+    const char * key;
+    size_t len;
+    while (reader.next_member(key, len)) {
+        size_t match = count;
+        for (size_t n = 0; n < count; n++) {
+            const size_t f = hint + n < count ? hint + n : hint + n - count;
+            if (fields[f].len == len && std::char_traits<char>::compare(fields[f].name, key, len) == 0) {
+                match = f;
+                break;
+            }
+        }
+        if (match == count) {
+            if (!reader.skip())
+                return false;
+            continue;
+        }
+        if (!fields[match].read(reader, out))
+            return false;
+        hint = match + 1 == count ? 0 : match + 1;
+    }
+    return !reader.failed();
+}
+
+/* from_json(in, out, err, strategy, max_depth)
+ *
+ * Parse in, which must hold exactly one value, into out. If parsing fails, return false and
+ * assign an error message to err; out may then be partially filled.
+ */
+template <class T>
+bool from_json(const std::string & in, T & out, std::string & err,
+               JsonParse strategy = JsonParse::STANDARD,
+               int max_depth = Json::default_max_depth) {
+    JsonReader reader(in, err, strategy, max_depth);
+    return from_json(reader, out) && reader.finish();
+}
+
 // Internal class hierarchy - JsonValue objects are not exposed to users of this API.
 class JsonValue {
 protected:
@@ -218,6 +737,9 @@ protected:
     virtual bool equals(const JsonValue * other) const = 0;
     virtual bool less(const JsonValue * other) const = 0;
     virtual void dump(std::string &out) const = 0;
+    virtual size_t hash() const = 0;
+    virtual size_t cached_hash() const;
+    virtual void cache_dump() const;
     virtual double number_value() const;
     virtual int int_value() const;
     virtual bool bool_value() const;
@@ -230,3 +752,10 @@ protected:
 };
 
 } // namespace json11
+
+namespace std {
+template <>
+struct hash<json11::Json> {
+    size_t operator()(const json11::Json & json) const { return json.hash(); }
+};
+} // namespace std
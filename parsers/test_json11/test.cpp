@@ -0,0 +1,77 @@
+/* Tests for the typed reader.
+ *
+ * Build and run with:
+ *     g++ -std=c++11 -pthread test.cpp json11.cpp -o test && ./test
+ */
+#include "json11.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace json11;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+struct Point {
+    int x = 0;
+    int y = 0;
+
+    static const std::vector<JsonField<Point>> & json_fields() {
+        static const std::vector<JsonField<Point>> fields {
+            JSON11_FIELD(Point, x), JSON11_FIELD(Point, y),
+        };
+        return fields;
+    }
+};
+
+static std::string nested(const std::string & open, const std::string & close, int depth) {
+    std::string out;
+    for (int k = 0; k < depth; k++)
+        out += open;
+    out += "1";
+    for (int k = 0; k < depth; k++)
+        out += close;
+    return out;
+}
+
+// Unknown members of every type are skipped, and reading carries on after them.
+static void test_skip() {
+    std::string err;
+    Point p;
+    CHECK(from_json(R"({"a": null, "x": 1, "b": [1, "s", {"c": [], "d": {}}], "e": "\"}", "y": 2})",
+                    p, err));
+    CHECK(p.x == 1 && p.y == 2);
+
+    CHECK(!from_json(R"({"a": [1, 2}, "x": 1})", p, err));
+    CHECK(!err.empty());
+}
+
+// Skipping a deeply nested unknown member is bounded by max_depth, not by the call stack.
+static void test_skip_deep() {
+    const int depth = 1000000;
+    std::string err;
+    Point p;
+
+    const std::string arrays = "{\"zz\": " + nested("[", "]", depth) + ", \"x\": 3}";
+    CHECK(from_json(arrays, p, err, JsonParse::STANDARD, depth + 1));
+    CHECK(p.x == 3);
+
+    const std::string objects = "{\"zz\": " + nested("{\"k\": ", "}", depth) + ", \"y\": 4}";
+    CHECK(from_json(objects, p, err, JsonParse::STANDARD, depth + 1));
+    CHECK(p.y == 4);
+
+    CHECK(!from_json(arrays, p, err));
+    CHECK(err == "exceeded maximum nesting depth");
+}
+
+int main() {
+    test_skip();
+    test_skip_deep();
+    std::printf("all tests passed\n");
+    return 0;
+}
@@ -25,7 +25,7 @@ programs = {
     {
         "url": os.path.join(PARSERS_DIR, "test_json11"),
         "setup": ["g++", os.path.join(PARSERS_DIR, "test_json11/main.cpp"), os.path.join(PARSERS_DIR, "test_json11/json11.cpp"),
-                  "-o", os.path.join(PARSERS_DIR, "test_json11/test_json11.exe")],
+                  "-pthread", "-o", os.path.join(PARSERS_DIR, "test_json11/test_json11.exe")],
         "commands": [os.path.join(PARSERS_DIR, "test_json11/test_json11.exe")]
     },
     "Configuru":